@@ -47,6 +47,10 @@
 #define STATE_SENDING         1
 #define STATE_OFFER_RECEIVED  2
 #define STATE_CONFIG_RECEIVED 3
+#define STATE_REBOOTING       4
+
+/* INIT-REBOOT requests sent before keeping the stored lease unconfirmed. */
+#define REBOOT_TRIES          4
 
 #define MYHOST "SDSERV"
 
@@ -114,7 +118,7 @@ add_server_id(u8_t *optptr)
 {
     *optptr++ = DHCP_OPTION_SERVER_ID;
     *optptr++ = 4;
-    memcpy(optptr, s.serverid, 4);
+    memcpy(optptr, s.lease.serverid, 4);
     return optptr + 4;
 }
 /*---------------------------------------------------------------------------*/
@@ -123,7 +127,7 @@ add_req_ipaddr(u8_t *optptr)
 {
     *optptr++ = DHCP_OPTION_REQ_IPADDR;
     *optptr++ = 4;
-    memcpy(optptr, s.ipaddr, 4);
+    memcpy(optptr, s.lease.ipaddr, 4);
     return optptr + 4;
 }
 /*---------------------------------------------------------------------------*/
@@ -197,7 +201,13 @@ send_request(void)
     create_msg(m);
 
     end = add_msg_type(&m->options[4], DHCPREQUEST);
-    end = add_server_id(end);
+    if(s.state == STATE_REBOOTING) {
+        /* INIT-REBOOT: no server chosen and ciaddr zero. The stored
+           address is not configured yet, the source is 0.0.0.0. */
+        memset(m->ciaddr, 0, sizeof(m->ciaddr));
+    } else {
+        end = add_server_id(end);
+    }
     end = add_req_ipaddr(end);
     end = add_end(end);
 
@@ -215,22 +225,22 @@ parse_options(u8_t *optptr, int len)
     while(optptr < end) {
         switch(*optptr) {
             case DHCP_OPTION_SUBNET_MASK:
-                memcpy(s.netmask, optptr + 2, 4);
+                memcpy(s.lease.netmask, optptr + 2, 4);
                 break;
             case DHCP_OPTION_ROUTER:
-                memcpy(s.default_router, optptr + 2, 4);
+                memcpy(s.lease.default_router, optptr + 2, 4);
                 break;
             case DHCP_OPTION_DNS_SERVER:
-                memcpy(s.dnsaddr, optptr + 2, 4);
+                memcpy(s.lease.dnsaddr, optptr + 2, 4);
                 break;
             case DHCP_OPTION_MSG_TYPE:
                 type = *(optptr + 2);
                 break;
             case DHCP_OPTION_SERVER_ID:
-                memcpy(s.serverid, optptr + 2, 4);
+                memcpy(s.lease.serverid, optptr + 2, 4);
                 break;
             case DHCP_OPTION_LEASE_TIME:
-                memcpy(s.lease_time, optptr + 2, 4);
+                memcpy(s.lease.lease_time, optptr + 2, 4);
                 break;
             case DHCP_OPTION_END:
                 return type;
@@ -245,7 +255,8 @@ parse_options(u8_t *optptr, int len)
 void print_dhcp_msg(struct dhcp_msg *msg) {
     printf("op %d\n", msg->op);
     printf("xid %x %x %x %x\n", msg->xid[0], msg->xid[1], msg->xid[2], msg->xid[3]);
-    printf("chaddr %x\n", msg->chaddr);
+    printf("chaddr %x:%x:%x:%x:%x:%x\n", msg->chaddr[0], msg->chaddr[1], msg->chaddr[2],
+           msg->chaddr[3], msg->chaddr[4], msg->chaddr[5]);
     printf("yiaddr %d %d %d %d\n", msg->yiaddr[0], msg->yiaddr[1], msg->yiaddr[2], msg->yiaddr[3]);
 
 }
@@ -262,7 +273,7 @@ parse_msg(void)
 
 // bugfix: copy ipaddr to state.
 	for (int j=0; j<4; j++)
-	        ((u8_t*)s.ipaddr)[j] = m->yiaddr[j];
+	        ((u8_t*)s.lease.ipaddr)[j] = m->yiaddr[j];
 
         res = parse_options(&m->options[4], uip_datalen());
         //printf("parse_options == %d\n", res);
@@ -274,8 +285,45 @@ parse_msg(void)
     static
 PT_THREAD(handle_dhcp(void))
 {
+    u8_t type;
+
     PT_BEGIN(&s.pt);
 
+    if(s.state == STATE_REBOOTING) {
+        s.ticks = CLOCK_SECOND;
+        do {
+            send_request();
+            timer_set(&s.timer, s.ticks);
+            PT_YIELD_UNTIL(&s.pt, uip_newdata() || timer_expired(&s.timer));
+
+            if(uip_newdata()) {
+                type = parse_msg();
+                if(type == DHCPACK) {
+                    s.state = STATE_CONFIG_RECEIVED;
+                } else if(type == DHCPNAK) {
+                    s.state = STATE_INITIAL;
+                }
+            }
+            s.ticks += CLOCK_SECOND;
+        } while(s.state == STATE_REBOOTING &&
+                s.ticks <= CLOCK_SECOND * REBOOT_TRIES);
+
+        if(s.state == STATE_REBOOTING) {
+            /* No server answered: RFC 2131 lets us use the stored lease
+               until it expires. The time before the reboot is unknown,
+               the lease time counts from now. */
+            s.expires = ntohs(s.lease.lease_time[0])*65536ul +
+                ntohs(s.lease.lease_time[1]);
+            s.state = STATE_CONFIG_RECEIVED;
+        }
+        if(s.state == STATE_CONFIG_RECEIVED) {
+            goto bound;
+        }
+
+        /* Refused, the address may belong to someone else by now. */
+        pmesg(MSG_INFO, "Stored lease refused\n");
+    }
+
     /* try_again:*/
     s.state = STATE_SENDING;
     s.ticks = CLOCK_SECOND;
@@ -316,25 +364,41 @@ PT_THREAD(handle_dhcp(void))
         }
     } while(s.state != STATE_CONFIG_RECEIVED);
 
+bound:
     pmesg(MSG_INFO, "Got IP address %d.%d.%d.%d\n",
-            uip_ipaddr1(s.ipaddr), uip_ipaddr2(s.ipaddr),
-            uip_ipaddr3(s.ipaddr), uip_ipaddr4(s.ipaddr));
+            uip_ipaddr1(s.lease.ipaddr), uip_ipaddr2(s.lease.ipaddr),
+            uip_ipaddr3(s.lease.ipaddr), uip_ipaddr4(s.lease.ipaddr));
     pmesg(MSG_INFO, "Got netmask %d.%d.%d.%d\n",
-            uip_ipaddr1(s.netmask), uip_ipaddr2(s.netmask),
-            uip_ipaddr3(s.netmask), uip_ipaddr4(s.netmask));
+            uip_ipaddr1(s.lease.netmask), uip_ipaddr2(s.lease.netmask),
+            uip_ipaddr3(s.lease.netmask), uip_ipaddr4(s.lease.netmask));
     pmesg(MSG_INFO, "Got DNS server %d.%d.%d.%d\n",
-            uip_ipaddr1(s.dnsaddr), uip_ipaddr2(s.dnsaddr),
-            uip_ipaddr3(s.dnsaddr), uip_ipaddr4(s.dnsaddr));
+            uip_ipaddr1(s.lease.dnsaddr), uip_ipaddr2(s.lease.dnsaddr),
+            uip_ipaddr3(s.lease.dnsaddr), uip_ipaddr4(s.lease.dnsaddr));
     pmesg(MSG_INFO, "Got default router %d.%d.%d.%d\n",
-            uip_ipaddr1(s.default_router), uip_ipaddr2(s.default_router),
-            uip_ipaddr3(s.default_router), uip_ipaddr4(s.default_router));
+            uip_ipaddr1(s.lease.default_router), uip_ipaddr2(s.lease.default_router),
+            uip_ipaddr3(s.lease.default_router), uip_ipaddr4(s.lease.default_router));
     pmesg(MSG_INFO, "Lease expires in %ld seconds\n",
-            ntohs(s.lease_time[0])*65536ul + ntohs(s.lease_time[1]));
+            ntohs(s.lease.lease_time[0])*65536ul + ntohs(s.lease.lease_time[1]));
 
     dhcpc_configured(&s);
 
     /* timer_stop(&s.timer);*/
 
+    /* An unconfirmed stored lease is dropped when it runs out, a
+       minute at a time to keep the timer interval small. An infinite
+       lease never does. */
+    while(s.expires && s.expires != 0xfffffffful) {
+        s.ticks = s.expires < 60 ? s.expires : 60;
+        timer_set(&s.timer, CLOCK_SECOND * s.ticks);
+        PT_YIELD_UNTIL(&s.pt, timer_expired(&s.timer));
+        s.expires -= s.ticks;
+        if(!s.expires) {
+            pmesg(MSG_INFO, "Stored lease expired\n");
+            dhcpc_unconfigured(&s);
+            PT_RESTART(&s.pt);
+        }
+    }
+
     /*
      * PT_END restarts the thread so we do this instead. Eventually we
      * should reacquire expired leases here.
@@ -362,6 +426,14 @@ dhcpc_init(const void *mac_addr, int mac_len)
     }
     PT_INIT(&s.pt);
 }
+/*---------------------------------------------------------------------------*/
+    void
+dhcpc_reboot(const struct dhcpc_lease *lease)
+{
+    s.lease = *lease;
+    s.state = STATE_REBOOTING;
+    s.expires = 0;
+}
 /*---------------------------------------------------------------------------*/
 
 void
@@ -36,31 +36,52 @@
 #include "timer.h"
 #include "pt.h"
 
+/* What the server granted, kept across reboots by the application.
+   router_mac is not DHCP's: the application fills it in from the ARP
+   table, all zeroes while unknown. */
+struct dhcpc_lease {
+  u8_t serverid[4];
+
+  u16_t lease_time[2];
+  u16_t ipaddr[2];
+  u16_t netmask[2];
+  u16_t dnsaddr[2];
+  u16_t default_router[2];
+  u8_t router_mac[6];
+};
+
 struct dhcpc_state {
   struct pt pt;
   char state;
   struct uip_udp_conn *conn;
   struct timer timer;
   u16_t ticks;
+  unsigned long expires;	/* Seconds left of an unconfirmed lease. */
   const void *mac_addr;
   int mac_len;
-  
-  u8_t serverid[4];
 
-  u16_t lease_time[2];
-  u16_t ipaddr[2];
-  u16_t netmask[2];
-  u16_t dnsaddr[2];
-  u16_t default_router[2];
+  struct dhcpc_lease lease;
 };
 
 void dhcpc_init(const void *mac_addr, int mac_len);
 void dhcpc_request(void);
 
+/* Start from a lease stored by an earlier run instead of DISCOVER:
+   call after dhcpc_init(), with the host address still unset. It is
+   confirmed with an INIT-REBOOT REQUEST from 0.0.0.0 (RFC 2131, 3.2).
+   dhcpc_configured() follows the ACK, or the last retry without an
+   answer; in that case dhcpc_unconfigured() follows when the lease
+   time has passed and DISCOVER starts over. A NAK falls back to
+   DISCOVER right away. */
+void dhcpc_reboot(const struct dhcpc_lease *lease);
+
 void dhcpc_appcall(void);
 
 void dhcpc_configured(const struct dhcpc_state *s);
 
+/* The address from dhcpc_configured() is no longer ours. */
+void dhcpc_unconfigured(const struct dhcpc_state *s);
+
 typedef struct dhcpc_state uip_udp_appstate_t;
 #define UIP_UDP_APPCALL dhcpc_appcall
 
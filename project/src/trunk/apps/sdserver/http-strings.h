@@ -3,6 +3,8 @@ extern const char http_200[5];
 extern const char http_301[5];
 extern const char http_302[5];
 extern const char http_get[5];
+extern const char http_put[5];
+extern const char http_post[6];
 extern const char http_10[9];
 extern const char http_11[9];
 extern const char http_content_type[15];
@@ -11,10 +13,17 @@ extern const char http_location[11];
 extern const char http_host[7];
 extern const char http_crnl[3];
 extern const char http_index_html[12];
+extern const char http_index_htm[11];
+extern const char http_stats_txt[11];
 extern const char http_404_html[10];
 extern const char http_referer[9];
+extern const char http_content_length[16];
 extern const char http_header_200[84];
 extern const char http_header_404[91];
+extern const char http_header_201[89];
+extern const char http_header_500[103];
+extern const char http_header_503[101];
+extern const char http_reject_503[119];
 extern const char http_content_type_plain[29];
 extern const char http_content_type_html[28];
 extern const char http_content_type_css [27];
@@ -60,14 +60,22 @@
 #include "httpd-fs.h"
 #include "httpd-cgi.h"
 #include "http-strings.h"
+#include "mime-types.h"
 #include "fserv.h"
+#include "memb.h"
 
+#include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 
+#include "boot.h"
 #include "debug.h"
+#include "trace.h"
+#include "stack.h"
 
 #define STATE_WAITING 0
 #define STATE_OUTPUT  1
+#define STATE_UPLOAD  2
 
 #define ISO_nl      0x0a
 #define ISO_space   0x20
@@ -77,20 +85,98 @@
 #define ISO_slash   0x2f
 #define ISO_colon   0x3a
 
+MEMB_TYPED(states, struct httpd_state, HTTPD_CONF_MAX_STREAMS);
 
+static unsigned char sched_last;  /* uip_conns index of the last turn */
+
+/*---------------------------------------------------------------------------*/
+/* Returns the connection whose turn it is to read the card: the first one
+   after the last reader, in uip_conns order, that is waiting or is the
+   one asking. */
+static struct uip_conn *sched_turn(struct uip_conn *asking)
+{
+    struct uip_conn *c;
+    unsigned char n;
+
+    for(n = 1; n <= UIP_CONNS; n++) {
+	c = &uip_conns[(sched_last + n) % UIP_CONNS];
+	if(c == asking) {
+	    return c;
+	}
+	if((c->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
+		c->appstate.s != NULL && c->appstate.s->sched_wait) {
+	    return c;
+	}
+    }
+    return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Decides whether the current connection may read its next segment from
+   the card now. Small files and the first segment of a file always may,
+   so that short requests are not stuck behind downloads. Other reads are
+   taken round-robin between the connections asking for one. */
+static char sched_grant(struct httpd_state *s)
+{
+    if(s->file.offset == 0 ||
+	    s->file.offset + s->file.len <= HTTPD_CONF_SMALL_FILE) {
+	return 1;
+    }
+    if(sched_turn(uip_conn) != uip_conn) {
+	s->sched_wait = 1;
+	return 0;
+    }
+    s->sched_wait = 0;
+    sched_last = (unsigned char)(uip_conn - uip_conns);
+    return 1;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief      Get the connection that should read the card next
+ *
+ *             Connections waiting for their turn are only resumed when
+ *             polled. The main loop calls this function and polls the
+ *             returned connection with uip_poll_conn().
+ *
+ * \return     The connection to poll, or NULL if none is waiting.
+ */
+struct uip_conn *httpd_sched_next(void)
+{
+    return sched_turn(NULL);
+}
+/*---------------------------------------------------------------------------*/
+unsigned char httpd_streams(unsigned char *peak)
+{
+    if(peak != NULL) {
+	*peak = memb_peak(&states);
+    }
+    return memb_used(&states);
+}
+/*---------------------------------------------------------------------------*/
+static void release(struct httpd_conn *c)
+{
+    if(c->s != NULL) {
+	states_free(c->s);
+	c->s = NULL;
+    }
+}
 /*---------------------------------------------------------------------------*/
 static unsigned short generate_part_of_file(void *state)
 {
     struct httpd_state *s = (struct httpd_state *)state;
 
-    if(s->file.len > uip_mss()) {
-	s->len = uip_mss();
-    } 
-    else {
+    s->len = uip_mss();
+    if(s->len > S_SIZ) {
+	/* End the segment on a card sector boundary. Whole sectors are
+	   read from the card straight into the packet, only a partial
+	   one goes through the file buffer. */
+	s->len -= (s->file.offset + s->len) % S_SIZ;
+    }
+    if(s->file.len < s->len) {
 	s->len = s->file.len;
     }
 
 pmesg(MSG_DEBUG, "\ncall GetElementData with fname=%s, offset=%d, len=%d\n",s->filename,s->file.offset,s->len);
+    TRACE_EV(TEV_HTTP_PART, s->len, s->file.offset);
     fsGetElementData(s->filename, uip_appdata, s->file.offset, s->len);
     s->file.offset += s->len;
     
@@ -103,6 +189,7 @@ static PT_THREAD(send_file(struct httpd_state *s))
     PSOCK_BEGIN(&s->sout);
 
     do {
+	PSOCK_WAIT_UNTIL(&s->sout, sched_grant(s));
 	PSOCK_GENERATOR_SEND(&s->sout, generate_part_of_file, s);
 	s->file.len -= s->len;
 	s->file.data += s->len;
@@ -111,6 +198,80 @@ static PT_THREAD(send_file(struct httpd_state *s))
     PSOCK_END(&s->sout);
 }
 /*---------------------------------------------------------------------------*/
+#if TRACE_EVENTS
+static const char http_trace_bin[] = "/trace.bin";
+
+/* A segment of /trace.bin: a TEV_CLOCK event, then the events of the
+   ring from file.offset on, up to the newest one when the request came
+   in (file.len). uip_appdata is not word aligned, hence the memcpy. */
+static unsigned short generate_trace(void *state)
+{
+    struct httpd_state *s = (struct httpd_state *)state;
+    traceEvent_t ev;
+    DWORD pos = s->file.offset;
+
+    s->len = 0;
+    traceClock(&ev);
+    do {
+	memcpy((char *)uip_appdata + s->len, &ev, sizeof(ev));
+	s->len += sizeof(ev);
+    } while(s->len + sizeof(ev) <= uip_mss() && pos < (DWORD)s->file.len &&
+	    traceRead(&pos, &ev));
+    s->trace_next = pos;
+
+    return s->len;
+}
+/*---------------------------------------------------------------------------*/
+static PT_THREAD(send_trace(struct httpd_state *s))
+{
+    PSOCK_BEGIN(&s->sout);
+
+    do {
+	PSOCK_GENERATOR_SEND(&s->sout, generate_trace, s);
+	s->file.offset = s->trace_next;
+    } while((DWORD)s->file.offset < (DWORD)s->file.len);
+
+    PSOCK_END(&s->sout);
+}
+#endif
+/*---------------------------------------------------------------------------*/
+/* /stats.txt: where the RAM goes at run time, the stack high-water marks
+   first. One segment, the page is short. */
+static unsigned short generate_stats(void *state)
+{
+    stackUse_t use[STACK_MODES];
+    char *p = (char *)uip_appdata;
+    unsigned short len = 0, mss = uip_mss();
+    unsigned char i, peak;
+
+    stackUse(use);
+    for(i = 0; i < STACK_MODES && len < mss; i++) {
+	len += snprintf(p + len, mss - len, "stack %s %lu used %lu\n",
+		use[i].name, (unsigned long)use[i].size,
+		(unsigned long)use[i].used);
+    }
+    if(len < mss) {
+	len += snprintf(p + len, mss - len, "ram untouched %lu\n",
+		(unsigned long)stackFreeRam());
+    }
+    if(len < mss) {
+	i = httpd_streams(&peak);
+	len += snprintf(p + len, mss - len, "streams %u of %u peak %u\n",
+		i, HTTPD_CONF_MAX_STREAMS, peak);
+    }
+
+    return len < mss ? len : mss;
+}
+/*---------------------------------------------------------------------------*/
+static PT_THREAD(send_stats(struct httpd_state *s))
+{
+    PSOCK_BEGIN(&s->sout);
+
+    PSOCK_GENERATOR_SEND(&s->sout, generate_stats, s);
+
+    PSOCK_END(&s->sout);
+}
+/*---------------------------------------------------------------------------*/
 static PT_THREAD(send_part_of_file(struct httpd_state *s))
 {
     PSOCK_BEGIN(&s->sout);
@@ -188,86 +349,186 @@ static PT_THREAD(handle_script(struct httpd_state *s))
     PT_END(&s->scriptpt);
 }
 /*---------------------------------------------------------------------------*/
+/* Looks up the file name extension in the table generated by makestrings
+   from mime-types. The extension is matched case-insensitively, with a
+   single probe. Returns NULL for an unknown extension. */
+static const struct http_mime *mime_lookup(const char *ext)
+{
+    unsigned long key = 0;
+    unsigned char i, c, slot;
 
-static PT_THREAD(send_headers(struct httpd_state *s, const char *statushdr))
+    for(i = 0; ext[i] != 0; i++) {
+	if(i == HTTP_MIME_EXTLEN) {
+	    return NULL;
+	}
+	c = ext[i];
+	if(c >= 'a' && c <= 'z') {
+	    c -= 'a' - 'A';
+	}
+	if(c <= ' ' || c >= '`') {
+	    return NULL;		/* Not in the 6-bit key alphabet */
+	}
+	key |= (unsigned long)(c - ' ') << (6 * i);
+    }
+
+    slot = (unsigned char)(((key * HTTP_MIME_MULT2) & 0xffffffffUL) >>
+			   (32 - HTTP_MIME_BITS)) ^
+	http_mime_disp[((key * HTTP_MIME_MULT1) & 0xffffffffUL) >>
+		       (32 - HTTP_MIME_DBITS)];
+    if(key == 0 || http_mime_table[slot].key != key) {
+	return NULL;
+    }
+    return &http_mime_table[slot];
+}
+/*---------------------------------------------------------------------------*/
+static const char *content_type(struct httpd_state *s)
 {
+    const struct http_mime *m;
     char *ptr;
 
+    if(s->file.type == FSERV_DIR) {
+	return http_content_type_html;	/* Directory listing */
+    }
+    ptr = strrchr(s->filename, ISO_period);
+    if(ptr == NULL) {
+	return http_content_type_binary;
+    }
+    m = mime_lookup(ptr + 1);
+    return (m != NULL) ? m->hdr : http_content_type_plain;
+}
+/*---------------------------------------------------------------------------*/
+static PT_THREAD(send_headers(struct httpd_state *s, const char *statushdr))
+{
     PSOCK_BEGIN(&s->sout);
 
+    bootMark(BOOT_SERVED);
     PSOCK_SEND_STR(&s->sout, statushdr);
+    PSOCK_SEND_STR(&s->sout, content_type(s));
 
-    ptr = strrchr(s->filename, ISO_period);
-    if(ptr == NULL) {
-	PSOCK_SEND_STR(&s->sout, http_content_type_binary);
-    } 
-    else if(strncmp(http_html, ptr, 5) == 0 ||
-	    strncmp(http_shtml, ptr, 6) == 0) {
-	PSOCK_SEND_STR(&s->sout, http_content_type_html);
-    } 
-    else if(strncmp(http_css, ptr, 4) == 0) {
-	PSOCK_SEND_STR(&s->sout, http_content_type_css);
-    } 
-    else if(strncmp(http_png, ptr, 4) == 0) {
-	PSOCK_SEND_STR(&s->sout, http_content_type_png);
-    } 
-    else if(strncmp(http_gif, ptr, 4) == 0) {
-	PSOCK_SEND_STR(&s->sout, http_content_type_gif);
-    } 
-    else if(strncmp(http_jpg, ptr, 4) == 0) {
-	PSOCK_SEND_STR(&s->sout, http_content_type_jpg);
-    } 
-    else {
-	PSOCK_SEND_STR(&s->sout, http_content_type_plain);
+    PSOCK_END(&s->sout);
+}
+/*---------------------------------------------------------------------------*/
+static const char *upload_status_header(struct httpd_state *s)
+{
+    switch(s->upload_status) {
+    case FR_OK:
+	return http_header_201;
+    case FR_NOT_READY:
+	return http_header_503;	/* Another upload is running */
+    default:
+	return http_header_500;
     }
+}
+/*---------------------------------------------------------------------------*/
+static PT_THREAD(send_upload_status(struct httpd_state *s))
+{
+    PSOCK_BEGIN(&s->sout);
+
+    PSOCK_SEND_STR(&s->sout, upload_status_header(s));
+    PSOCK_SEND_STR(&s->sout, http_crnl);
+
     PSOCK_END(&s->sout);
 }
 /*---------------------------------------------------------------------------*/
+static void upload_data(struct httpd_state *s, char *data, unsigned short len)
+{
+    FRESULT fres;
+
+    if(!s->upload_nolen && len > s->upload_left) {
+	len = s->upload_left;
+    }
+    fres = fsUploadWrite(data, len);
+    if(fres != FR_OK) {
+	s->upload_status = fres;
+	fsUploadEnd(FALSE);
+    }
+    s->upload_left -= len;
+}
+/*---------------------------------------------------------------------------*/
+static void upload_abort(struct httpd_state *s)
+{
+    if(s->state == STATE_UPLOAD) {
+	if(s->upload_status == FR_OK) {
+	    fsUploadEnd(FALSE);
+	}
+	s->state = STATE_WAITING;
+    }
+}
+/*---------------------------------------------------------------------------*/
+static const char * const index_docs[] = { http_index_html, http_index_htm };
+
 static PT_THREAD(handle_output(struct httpd_state *s))
 {
-    char isIndex = 0;
     char *ptr;
     FRESULT fres;
-    char *fname = s->filename;
+    unsigned char i;
     PT_BEGIN(&s->outputpt);
+
+    if(s->method == HTTPD_METHOD_PUT) {
+	PT_WAIT_THREAD(&s->outputpt, send_upload_status(s));
+	PSOCK_CLOSE(&s->sout);
+	PT_EXIT(&s->outputpt);
+    }
     
-    if (!strcmp(s->filename, "/index.html"))
+#if TRACE_EVENTS
+    /* The event ring, for host/tracedump. */
+    if(!strcmp(s->filename, http_trace_bin)) {
+	s->file.type = FSERV_FILE;
+	s->file.offset = traceStart();
+	s->file.len = traceHead;
+	PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_200));
+	PT_WAIT_THREAD(&s->outputpt, send_trace(s));
+	PSOCK_CLOSE(&s->sout);
+	PT_EXIT(&s->outputpt);
+    }
+#endif
+
+    if(!strcmp(s->filename, http_stats_txt)) {
+	s->file.type = FSERV_FILE;
+	PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_200));
+	PT_WAIT_THREAD(&s->outputpt, send_stats(s));
+	PSOCK_CLOSE(&s->sout);
+	PT_EXIT(&s->outputpt);
+    }
+
+    /* The root is served by its index document if there is one,
+       by the root listing otherwise. An explicit /index.html gets the
+       same fallback to /index.htm. */
+    if (!strcmp(s->filename, "/") || !strcmp(s->filename, http_index_html))
     {
-	isIndex = 1;
-	fname = "/index.htm"; // FS does not support long filenames.
-    }
-
-       fres = fsGetElementInfo(fname, &s->file.type, &s->file.len);
-        
-       /* Checks if index document is requested and availalbe.:
-          In case it is not available return the root listing. */
-        if (isIndex)
-        {		
-                if (s->file.type == FSERV_NONEXSIT)
-                { 
-                    pmesg(MSG_DEBUG,"info: recognized as root dir listing\n");
-		    strcpy(s->filename,"/");
-		    fname = "/"; //root dir listing.
-       		    fres = fsGetElementInfo(fname, &s->file.type, &s->file.len);
-                }
-		strcpy(s->filename,"/index.htm");
-        }
-
-	if (FSERV_NONEXSIT == s->file.type)
-        {
-		pmesg(MSG_DEBUG, "file not found\n");	 
-		
-                if (fres == FR_OK)
-		{
-			pmesg(MSG_DEBUG, "issue 404\n");
-			PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_404));
-		}
-        }
-	else { // File/Directory exists.
-		pmesg(MSG_DEBUG, "\nfile is found\n");
-                s->file.offset = 0;
-	        PT_WAIT_THREAD(&s->outputpt, send_file(s));	
+	for (i = 0; i < sizeof(index_docs) / sizeof(index_docs[0]); i++)
+	{
+	    fres = fsGetElementInfo(index_docs[i], &s->file.type, &s->file.len);
+	    if (fres == FR_OK && s->file.type == FSERV_FILE)
+	    {
+		strcpy(s->filename, index_docs[i]);
+		break;
+	    }
+	}
+	if (i == sizeof(index_docs) / sizeof(index_docs[0]))
+	{
+	    pmesg(MSG_DEBUG,"info: no index document for %s\n", s->filename);
+	    fres = fsGetElementInfo(s->filename, &s->file.type, &s->file.len);
+	}
+    }
+    else
+	fres = fsGetElementInfo(s->filename, &s->file.type, &s->file.len);
+
+    if (FSERV_NONEXSIT == s->file.type)
+    {
+	pmesg(MSG_DEBUG, "file not found\n");
+	if (fres == FR_OK)
+	{
+	    pmesg(MSG_DEBUG, "issue 404\n");
+	    PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_404));
 	}
+    }
+    else { // File/Directory exists.
+	pmesg(MSG_DEBUG, "\nfile is found\n");
+	s->file.offset = 0;
+	PT_WAIT_THREAD(&s->outputpt, send_headers(s, http_header_200));
+	PT_WAIT_THREAD(&s->outputpt, send_file(s));
+    }
 #if 0   
     
 
@@ -293,6 +554,32 @@ static PT_THREAD(handle_output(struct httpd_state *s))
     PT_END(&s->outputpt);
 }
 /*---------------------------------------------------------------------------*/
+static unsigned char hexval(char c)
+{
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return 16;
+}
+/*---------------------------------------------------------------------------*/
+/* Copy the request path, decoding %XX escapes: long file names come
+   with their spaces and other characters escaped. */
+static void url_decode(char *dst, const char *src, int size)
+{
+    unsigned char hi, lo;
+
+    while(*src && --size > 0) {
+	if(*src == ISO_percent && (hi = hexval(src[1])) < 16 &&
+	   (lo = hexval(src[2])) < 16) {
+	    *dst++ = (hi << 4) | lo;
+	    src += 3;
+	} else {
+	    *dst++ = *src++;
+	}
+    }
+    *dst = 0;
+}
+/*---------------------------------------------------------------------------*/
 static PT_THREAD(handle_input(struct httpd_state *s))
 {
     PSOCK_BEGIN(&s->sin);
@@ -300,7 +587,14 @@ static PT_THREAD(handle_input(struct httpd_state *s))
     PSOCK_READTO(&s->sin, ISO_space);
 
 
-    if(strncmp(s->inputbuf, http_get, 4) != 0) {
+    if(strncmp(s->inputbuf, http_get, 4) == 0) {
+	s->method = HTTPD_METHOD_GET;
+    } 
+    else if(strncmp(s->inputbuf, http_put, 4) == 0 ||
+	    strncmp(s->inputbuf, http_post, 5) == 0) {
+	s->method = HTTPD_METHOD_PUT;
+    } 
+    else {
 	PSOCK_CLOSE_EXIT(&s->sin);
     }
     PSOCK_READTO(&s->sin, ISO_space);
@@ -309,16 +603,59 @@ static PT_THREAD(handle_input(struct httpd_state *s))
 	PSOCK_CLOSE_EXIT(&s->sin);
     }
 
-    if(s->inputbuf[1] == ISO_space) {
-	strncpy(s->filename, http_index_html, sizeof(s->filename));
-    } 
-    else {
-	s->inputbuf[PSOCK_DATALEN(&s->sin) - 1] = 0;
-	strncpy(s->filename, &s->inputbuf[0], sizeof(s->filename));
-    }
+    s->inputbuf[PSOCK_DATALEN(&s->sin) - 1] = 0;
+    url_decode(s->filename, s->inputbuf, sizeof(s->filename));
 
     /*  httpd_log_file(uip_conn->ripaddr, s->filename);*/
 
+    if(s->method == HTTPD_METHOD_PUT) {
+	/* Read the headers up to the empty line, looking for the body
+	   length. Lines longer than inputbuf arrive in pieces, so only
+	   a piece that starts a line is looked at. */
+	s->upload_nolen = 1;
+	s->upload_left = 0;
+	s->bol = 1;
+	while(1) {
+	    PSOCK_READTO(&s->sin, ISO_nl);
+	    if(s->bol && PSOCK_DATALEN(&s->sin) <= 2 &&
+		    s->inputbuf[PSOCK_DATALEN(&s->sin) - 1] == ISO_nl) {
+		break;
+	    }
+	    if(s->bol && strncasecmp(s->inputbuf, http_content_length,
+			sizeof(http_content_length) - 1) == 0) {
+		s->inputbuf[PSOCK_DATALEN(&s->sin)] = 0;
+		s->upload_left = strtoul(&s->inputbuf[sizeof(http_content_length) - 1],
+			NULL, 10);
+		s->upload_nolen = 0;
+	    }
+	    s->bol = (s->inputbuf[PSOCK_DATALEN(&s->sin) - 1] == ISO_nl);
+	}
+
+	s->upload_status = fsUploadBegin(s->filename, s->upload_left);
+	s->state = STATE_UPLOAD;
+
+	/* Body bytes that came in the same segment as the headers. */
+	if(s->upload_status == FR_OK && s->sin.readlen > 0 &&
+		(s->upload_nolen || s->upload_left > 0)) {
+	    upload_data(s, (char *)s->sin.readptr, s->sin.readlen);
+	    s->sin.readlen = 0;
+	}
+	/* The rest is written straight from the incoming segments. */
+	while(s->upload_status == FR_OK &&
+		(s->upload_nolen || s->upload_left > 0)) {
+	    PT_YIELD_UNTIL(&s->sin.pt, uip_newdata());
+	    upload_data(s, (char *)uip_appdata, uip_datalen());
+	}
+
+	if(s->upload_status == FR_OK) {
+	    s->upload_status = fsUploadEnd(TRUE);
+	}
+	s->state = STATE_OUTPUT;
+
+	/* Nothing more to read, handle_output() answers and closes. */
+	PSOCK_WAIT_UNTIL(&s->sin, 0);
+    }
+
     s->state = STATE_OUTPUT;
 
     while(1) {
@@ -343,31 +680,72 @@ static void handle_connection(struct httpd_state *s)
 /*---------------------------------------------------------------------------*/
 void httpd_appcall(void)
 {
-    struct httpd_state *s = (struct httpd_state *)&(uip_conn->appstate);
+    struct httpd_conn *c = &uip_conn->appstate;
+    struct httpd_state *s = c->s;
 
     if(uip_closed() || uip_aborted() || uip_timedout()) {
-
+	if(s != NULL) {
+	    if(s->state == STATE_UPLOAD && s->upload_nolen && uip_closed()) {
+		/* No Content-Length: the client closing ends the body. */
+		if(s->upload_status == FR_OK) {
+		    fsUploadEnd(TRUE);
+		}
+		s->state = STATE_WAITING;
+	    }
+	    upload_abort(s);
+	}
+	release(c);
     } 
     else if(uip_connected()) {
+	c->timer = 0;
+	c->reject = 0;
+	c->s = s = states_alloc();
+	if(s == NULL) {
+	    /* Busy: answer at once rather than hold the connection open
+	       until a stream is free. */
+	    c->reject = 1;
+	    uip_send(http_reject_503, sizeof(http_reject_503) - 1);
+	    return;
+	}
+	s->sched_wait = 0;
 	PSOCK_INIT(&s->sin, s->inputbuf, sizeof(s->inputbuf) - 1);
 	PSOCK_INIT(&s->sout, s->inputbuf, sizeof(s->inputbuf) - 1);
 	PT_INIT(&s->outputpt);
 	s->state = STATE_WAITING;
 	/*    timer_set(&s->timer, CLOCK_SECOND * 100);*/
-	s->timer = 0;
 	handle_connection(s);
     } 
+    else if(c->reject) {
+	if(uip_rexmit()) {
+	    uip_send(http_reject_503, sizeof(http_reject_503) - 1);
+	} 
+	else if(uip_acked()) {
+	    uip_close();
+	} 
+	else if(uip_poll() && ++c->timer >= 20) {
+	    uip_abort();
+	}
+    } 
     else if(s != NULL) {
 	if(uip_poll()) {
-	    ++s->timer;
-	    if(s->timer >= 20) {
+	    /* Waiting for a turn at the card is not idling. */
+	    if(!s->sched_wait) {
+		++c->timer;
+	    }
+	    if(c->timer >= 20) {
+		upload_abort(s);
+		release(c);
 		uip_abort();
+		return;
 	    }
 	} 
 	else {
-	    s->timer = 0;
+	    c->timer = 0;
 	}
 	handle_connection(s);
+	if(uip_flags & (UIP_CLOSE | UIP_ABORT)) {
+	    release(c);
+	}
     } 
     else {
 	uip_abort();
@@ -382,6 +760,7 @@ void httpd_appcall(void)
  */
 void httpd_init(void)
 {
+    memb_init(&states);
     uip_listen(HTONS(80));
 }
 /*---------------------------------------------------------------------------*/
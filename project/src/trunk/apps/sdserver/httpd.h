@@ -38,12 +38,15 @@
 #include "psock.h"
 #include "httpd-fs.h"
 
+/* The state of a request being served. Taken from a pool of
+   HTTPD_CONF_MAX_STREAMS when a connection is admitted and given back
+   when it ends, so that only the connections being served pay for the
+   buffers. */
 struct httpd_state {
-    unsigned char timer;
     struct psock sin, sout;
     struct pt outputpt, scriptpt;
     char inputbuf[50];
-    char filename[20];
+    char filename[50];          /* Request path, long file names included */
     char state;
     struct httpd_fs_file file;
     int len;
@@ -51,10 +54,46 @@ struct httpd_state {
     int scriptlen;
 
     unsigned short count;
+
+    char method;                /* HTTPD_METHOD_GET or HTTPD_METHOD_PUT */
+    char bol;                   /* Last header read ended a line */
+    char upload_nolen;          /* No Content-Length, body ends at close */
+    char upload_status;         /* FRESULT of the upload */
+    unsigned long upload_left;  /* Body bytes still to be received */
+
+    char sched_wait;            /* Waiting for its turn to read the card */
+    unsigned long trace_next;   /* Event after the /trace.bin segment sent */
+};
+
+/* What every uip_conn holds (uip_tcp_appstate_t). */
+struct httpd_conn {
+    struct httpd_state *s;      /* NULL unless admitted */
+    unsigned char timer;        /* Polls without progress */
+    char reject;                /* Answered 503, closing */
 };
 
+#define HTTPD_METHOD_GET 0
+#define HTTPD_METHOD_PUT 1      /* PUT, or POST with a raw body */
+
+/* Connections served at the same time, the size of the httpd_state
+   pool. Any connection over the limit is answered with 503 as soon as it
+   is established. */
+#ifndef HTTPD_CONF_MAX_STREAMS
+#define HTTPD_CONF_MAX_STREAMS 4
+#endif
+
+/* Files up to this size, and the first segment of any file, are read
+   from the card without waiting for their turn. */
+#ifndef HTTPD_CONF_SMALL_FILE
+#define HTTPD_CONF_SMALL_FILE 4096
+#endif
+
 void httpd_init(void);
 void httpd_appcall(void);
+struct uip_conn *httpd_sched_next(void);
+
+/* Connections being served now, and the most ever served at once. */
+unsigned char httpd_streams(unsigned char *peak);
 
 void httpd_log(char *msg);
 void httpd_log_file(u16_t *requester, char *file);
@@ -0,0 +1,119 @@
+#include "mime-types.h"
+
+static const char http_mime_0[] = "Content-type: text/html\r\n\r\n";
+static const char http_mime_1[] = "Content-type: text/plain\r\n\r\n";
+static const char http_mime_2[] = "Content-type: text/csv\r\n\r\n";
+static const char http_mime_3[] = "Content-type: text/css\r\n\r\n";
+static const char http_mime_4[] = "Content-type: application/javascript\r\n\r\n";
+static const char http_mime_5[] = "Content-type: text/xml\r\n\r\n";
+static const char http_mime_6[] = "Content-type: application/json\r\n\r\n";
+static const char http_mime_7[] = "Content-type: image/png\r\n\r\n";
+static const char http_mime_8[] = "Content-type: image/gif\r\n\r\n";
+static const char http_mime_9[] = "Content-type: image/jpeg\r\n\r\n";
+static const char http_mime_10[] = "Content-type: image/bmp\r\n\r\n";
+static const char http_mime_11[] = "Content-type: image/x-icon\r\n\r\n";
+static const char http_mime_12[] = "Content-type: image/svg+xml\r\n\r\n";
+static const char http_mime_13[] = "Content-type: image/tiff\r\n\r\n";
+static const char http_mime_14[] = "Content-type: application/pdf\r\n\r\n";
+static const char http_mime_15[] = "Content-type: application/msword\r\n\r\n";
+static const char http_mime_16[] = "Content-type: application/vnd.ms-excel\r\n\r\n";
+static const char http_mime_17[] = "Content-type: application/vnd.ms-powerpoint\r\n\r\n";
+static const char http_mime_18[] = "Content-type: application/rtf\r\n\r\n";
+static const char http_mime_19[] = "Content-type: application/vnd.openxmlformats-officedocument.wordprocessingml.document\r\n\r\n";
+static const char http_mime_20[] = "Content-type: application/vnd.openxmlformats-officedocument.spreadsheetml.sheet\r\n\r\n";
+static const char http_mime_21[] = "Content-type: application/vnd.oasis.opendocument.text\r\n\r\n";
+static const char http_mime_22[] = "Content-type: application/zip\r\n\r\n";
+static const char http_mime_23[] = "Content-type: application/x-gzip\r\n\r\n";
+static const char http_mime_24[] = "Content-type: application/x-bzip2\r\n\r\n";
+static const char http_mime_25[] = "Content-type: application/x-7z-compressed\r\n\r\n";
+static const char http_mime_26[] = "Content-type: application/x-rar-compressed\r\n\r\n";
+static const char http_mime_27[] = "Content-type: application/java-archive\r\n\r\n";
+static const char http_mime_28[] = "Content-type: application/x-tar\r\n\r\n";
+static const char http_mime_29[] = "Content-type: application/x-iso9660-image\r\n\r\n";
+static const char http_mime_30[] = "Content-type: application/octet-stream\r\n\r\n";
+static const char http_mime_31[] = "Content-type: audio/mpeg\r\n\r\n";
+static const char http_mime_32[] = "Content-type: audio/ogg\r\n\r\n";
+static const char http_mime_33[] = "Content-type: audio/x-wav\r\n\r\n";
+static const char http_mime_34[] = "Content-type: audio/x-ms-wma\r\n\r\n";
+static const char http_mime_35[] = "Content-type: audio/flac\r\n\r\n";
+static const char http_mime_36[] = "Content-type: audio/mp4\r\n\r\n";
+static const char http_mime_37[] = "Content-type: audio/midi\r\n\r\n";
+static const char http_mime_38[] = "Content-type: video/mp4\r\n\r\n";
+static const char http_mime_39[] = "Content-type: video/mpeg\r\n\r\n";
+static const char http_mime_40[] = "Content-type: video/x-msvideo\r\n\r\n";
+static const char http_mime_41[] = "Content-type: video/quicktime\r\n\r\n";
+static const char http_mime_42[] = "Content-type: video/x-ms-wmv\r\n\r\n";
+static const char http_mime_43[] = "Content-type: video/x-matroska\r\n\r\n";
+static const char http_mime_44[] = "Content-type: video/x-flv\r\n\r\n";
+static const char http_mime_45[] = "Content-type: video/3gpp\r\n\r\n";
+
+const unsigned char http_mime_disp[16] = {
+  1, 4, 4, 3, 7, 0, 2, 8, 11, 0, 36, 33, 9, 0, 5, 10,
+};
+
+const struct http_mime http_mime_table[64] = {
+  {0x0002ea62UL, http_mime_30, 0}, /* bin */
+  {0x0002dd28UL, http_mime_0, 0}, /* htm */
+  {0x00029da1UL, http_mime_40, HTTP_MIME_COMPRESSED}, /* avi */
+  {0, 0, 0},
+  {0x009a6a74UL, http_mime_13, 0}, /* tiff */
+  {0x00bafceaUL, http_mime_6, 0}, /* json */
+  {0x008e1b26UL, http_mime_35, HTTP_MIME_COMPRESSED}, /* flac */
+  {0x00036877UL, http_mime_33, 0}, /* wav */
+  {0x000309d3UL, http_mime_45, HTTP_MIME_COMPRESSED}, /* 3gp */
+  {0x00029ba9UL, http_mime_1, 0}, /* ini */
+  {0, 0, 0},
+  {0x00e33b38UL, http_mime_20, HTTP_MIME_COMPRESSED}, /* xlsx */
+  {0x00b2dd28UL, http_mime_0, 0}, /* html */
+  {0x009e5c2dUL, http_mime_39, HTTP_MIME_COMPRESSED}, /* mpeg */
+  {0x00027c2aUL, http_mime_9, HTTP_MIME_COMPRESSED}, /* jpg */
+  {0x00025e25UL, http_mime_30, 0}, /* exe */
+  {0x00036ce3UL, http_mime_2, 0}, /* csv */
+  {0x00026d32UL, http_mime_18, 0}, /* rtf */
+  {0x0003492fUL, http_mime_21, HTTP_MIME_COMPRESSED}, /* odt */
+  {0, 0, 0},
+  {0x2cb74a33UL, http_mime_0, 0}, /* shtml */
+  {0x000279efUL, http_mime_32, HTTP_MIME_COMPRESSED}, /* ogg */
+  {0, 0, 0},
+  {0x009e5c2aUL, http_mime_9, HTTP_MIME_COMPRESSED}, /* jpeg */
+  {0, 0, 0},
+  {0x00036b26UL, http_mime_44, HTTP_MIME_COMPRESSED}, /* flv */
+  {0x0002f8e9UL, http_mime_11, 0}, /* ico */
+  {0x00023be4UL, http_mime_15, 0}, /* doc */
+  {0x00027c2dUL, http_mime_39, HTTP_MIME_COMPRESSED}, /* mpg */
+  {0x0003a9f4UL, http_mime_23, HTTP_MIME_COMPRESSED}, /* tgz */
+  {0x00012ea2UL, http_mime_24, HTTP_MIME_COMPRESSED}, /* bz2 */
+  {0x00000e97UL, http_mime_25, HTTP_MIME_COMPRESSED}, /* 7z */
+  {0x00026930UL, http_mime_14, 0}, /* pdf */
+  {0x000219efUL, http_mime_32, HTTP_MIME_COMPRESSED}, /* oga */
+  {0x00034c30UL, http_mime_17, 0}, /* ppt */
+  {0x00032872UL, http_mime_26, HTTP_MIME_COMPRESSED}, /* rar */
+  {0x0002cb78UL, http_mime_5, 0}, /* xml */
+  {0x00000ea7UL, http_mime_23, HTTP_MIME_COMPRESSED}, /* gz */
+  {0x00036aedUL, http_mime_43, HTTP_MIME_COMPRESSED}, /* mkv */
+  {0x00027bb0UL, http_mime_7, HTTP_MIME_COMPRESSED}, /* png */
+  {0x00b74a33UL, http_mime_0, 0}, /* shtm */
+  {0x00027db3UL, http_mime_12, 0}, /* svg */
+  {0x0003286aUL, http_mime_27, HTTP_MIME_COMPRESSED}, /* jar */
+  {0x00e23be4UL, http_mime_19, HTTP_MIME_COMPRESSED}, /* docx */
+  {0x00026a67UL, http_mime_8, HTTP_MIME_COMPRESSED}, /* gif */
+  {0x00000ceaUL, http_mime_4, 0}, /* js */
+  {0x00034e34UL, http_mime_1, 0}, /* txt */
+  {0x00036b77UL, http_mime_42, HTTP_MIME_COMPRESSED}, /* wmv */
+  {0x00013c2dUL, http_mime_31, HTTP_MIME_COMPRESSED}, /* mp3 */
+  {0x00024a6dUL, http_mime_37, 0}, /* mid */
+  {0x00027becUL, http_mime_1, 0}, /* log */
+  {0x00032874UL, http_mime_28, 0}, /* tar */
+  {0x00030b62UL, http_mime_10, 0}, /* bmp */
+  {0x00030a7aUL, http_mime_22, HTTP_MIME_COMPRESSED}, /* zip */
+  {0x00033b38UL, http_mime_16, 0}, /* xls */
+  {0, 0, 0},
+  {0x00021b77UL, http_mime_34, HTTP_MIME_COMPRESSED}, /* wma */
+  {0x00026a74UL, http_mime_13, 0}, /* tif */
+  {0x00036bedUL, http_mime_41, HTTP_MIME_COMPRESSED}, /* mov */
+  {0x0002152dUL, http_mime_36, HTTP_MIME_COMPRESSED}, /* m4a */
+  {0x00033ce3UL, http_mime_3, 0}, /* css */
+  {0x0003652dUL, http_mime_38, HTTP_MIME_COMPRESSED}, /* m4v */
+  {0x0002fce9UL, http_mime_29, 0}, /* iso */
+  {0x00014c2dUL, http_mime_38, HTTP_MIME_COMPRESSED}, /* mp4 */
+};
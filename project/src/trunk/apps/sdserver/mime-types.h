@@ -0,0 +1,16 @@
+#define HTTP_MIME_EXTLEN 5
+#define HTTP_MIME_BITS 6
+#define HTTP_MIME_DBITS 4
+#define HTTP_MIME_MULT1 0x1b0cab2bUL
+#define HTTP_MIME_MULT2 0x1a622739UL
+
+#define HTTP_MIME_COMPRESSED 0x01
+
+struct http_mime {
+  unsigned long key;
+  const char *hdr;
+  unsigned char flags;
+};
+
+extern const unsigned char http_mime_disp[16];
+extern const struct http_mime http_mime_table[64];
@@ -37,7 +37,7 @@
 
 #include "httpd.h"
 
-typedef struct httpd_state uip_tcp_appstate_t;
+typedef struct httpd_conn uip_tcp_appstate_t;
 /* UIP_APPCALL: the name of the application function. This function
    must return void and take no arguments (i.e., C type "void
    appfunc(void)"). */
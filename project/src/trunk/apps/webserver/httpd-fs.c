@@ -43,6 +43,10 @@
 
 #include "httpd-fsdata.c"
 
+#if HTTPD_FS_CHKSUM_MSS != UIP_TCP_MSS
+#warning "httpd-fsdata.c was generated for another MSS, segment checksums disabled"
+#endif
+
 #if HTTPD_FS_STATISTICS
 static u16_t count[HTTPD_FS_NUMFILES];
 #endif /* HTTPD_FS_STATISTICS */
@@ -85,6 +89,13 @@ httpd_fs_open(const char *name, struct httpd_fs_file *file)
     if(httpd_fs_strcmp(name, f->name) == 0) {
       file->data = f->data;
       file->len = f->len;
+      file->hdr = f->hdr;
+      file->hdrlen = f->hdrlen;
+#if HTTPD_FS_CHKSUM_MSS == UIP_TCP_MSS
+      file->chksum = f->chksum;
+#else
+      file->chksum = NULL;
+#endif
 #if HTTPD_FS_STATISTICS
       ++count[i];
 #endif /* HTTPD_FS_STATISTICS */
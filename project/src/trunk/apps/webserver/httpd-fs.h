@@ -40,6 +40,9 @@
 struct httpd_fs_file {
   char *data;
   int len;
+  char *hdr;        /* Complete response header, or NULL */
+  int hdrlen;
+  u16_t *chksum;    /* Sum of each UIP_TCP_MSS sized segment, or NULL */
 };
 
 /* file must be allocated by caller and will be filled in
@@ -23,6 +23,9 @@ static const unsigned char data_processes_shtml[] = {
 	0x73, 0xa, 0x25, 0x21, 0x3a, 0x20, 0x2f, 0x66, 0x6f, 0x6f, 
 	0x74, 0x65, 0x72, 0x2e, 0x68, 0x74, 0x6d, 0x6c, 0};
 
+static const char hdr_processes_shtml[] =
+	"HTTP/1.0 200 OK\r\nServer: uIP/1.0 http://www.sics.se/~adam/uip/\r\nConnection: close\r\nContent-type: text/html\r\n\r\n";
+
 static const unsigned char data_404_html[] = {
 	/* /404.html */
 	0x2f, 0x34, 0x30, 0x34, 0x2e, 0x68, 0x74, 0x6d, 0x6c, 0,
@@ -44,6 +47,12 @@ static const unsigned char data_404_html[] = {
 	0x79, 0x3e, 0xa, 0x3c, 0x2f, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 
 0};
 
+static const char hdr_404_html[] =
+	"HTTP/1.0 404 Not found\r\nServer: uIP/1.0 http://www.sics.se/~adam/uip/\r\nConnection: close\r\nContent-Length: 161\r\nContent-type: text/html\r\n\r\n";
+
+static const u16_t sum_404_html[] = {
+	0x5cfb, };
+
 static const unsigned char data_files_shtml[] = {
 	/* /files.shtml */
 	0x2f, 0x66, 0x69, 0x6c, 0x65, 0x73, 0x2e, 0x73, 0x68, 0x74, 0x6d, 0x6c, 0,
@@ -174,12 +183,21 @@ static const unsigned char data_files_shtml[] = {
 	0x2f, 0x66, 0x6f, 0x6f, 0x74, 0x65, 0x72, 0x2e, 0x68, 0x74, 
 	0x6d, 0x6c, 0xa, 0};
 
+static const char hdr_files_shtml[] =
+	"HTTP/1.0 200 OK\r\nServer: uIP/1.0 http://www.sics.se/~adam/uip/\r\nConnection: close\r\nContent-type: text/html\r\n\r\n";
+
 static const unsigned char data_footer_html[] = {
 	/* /footer.html */
 	0x2f, 0x66, 0x6f, 0x6f, 0x74, 0x65, 0x72, 0x2e, 0x68, 0x74, 0x6d, 0x6c, 0,
 	0x20, 0x20, 0x3c, 0x2f, 0x62, 0x6f, 0x64, 0x79, 0x3e, 0xa, 
 	0x3c, 0x2f, 0x68, 0x74, 0x6d, 0x6c, 0x3e, 0};
 
+static const char hdr_footer_html[] =
+	"HTTP/1.0 200 OK\r\nServer: uIP/1.0 http://www.sics.se/~adam/uip/\r\nConnection: close\r\nContent-Length: 18\r\nContent-type: text/html\r\n\r\n";
+
+static const u16_t sum_footer_html[] = {
+	0xb152, };
+
 static const unsigned char data_header_html[] = {
 	/* /header.html */
 	0x2f, 0x68, 0x65, 0x61, 0x64, 0x65, 0x72, 0x2e, 0x68, 0x74, 0x6d, 0x6c, 0,
@@ -247,6 +265,12 @@ static const unsigned char data_header_html[] = {
 	0x73, 0x3d, 0x22, 0x63, 0x6f, 0x6e, 0x74, 0x65, 0x6e, 0x74, 
 	0x62, 0x6c, 0x6f, 0x63, 0x6b, 0x22, 0x3e, 0xa, 0};
 
+static const char hdr_header_html[] =
+	"HTTP/1.0 200 OK\r\nServer: uIP/1.0 http://www.sics.se/~adam/uip/\r\nConnection: close\r\nContent-Length: 629\r\nContent-type: text/html\r\n\r\n";
+
+static const u16_t sum_header_html[] = {
+	0x76f4, };
+
 static const unsigned char data_index_html[] = {
 	/* /index.html */
 	0x2f, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2e, 0x68, 0x74, 0x6d, 0x6c, 0,
@@ -339,6 +363,12 @@ static const unsigned char data_index_html[] = {
 	0x6f, 0x64, 0x79, 0x3e, 0xa, 0x3c, 0x2f, 0x68, 0x74, 0x6d, 
 	0x6c, 0x3e, 0xa, 0};
 
+static const char hdr_index_html[] =
+	"HTTP/1.0 200 OK\r\nServer: uIP/1.0 http://www.sics.se/~adam/uip/\r\nConnection: close\r\nContent-Length: 874\r\nContent-type: text/html\r\n\r\n";
+
+static const u16_t sum_index_html[] = {
+	0xd433, };
+
 static const unsigned char data_style_css[] = {
 	/* /style.css */
 	0x2f, 0x73, 0x74, 0x79, 0x6c, 0x65, 0x2e, 0x63, 0x73, 0x73, 0,
@@ -445,6 +475,12 @@ static const unsigned char data_style_css[] = {
 	0x67, 0x6e, 0x3a, 0x72, 0x69, 0x67, 0x68, 0x74, 0x3b, 0x20, 
 	0xa, 0x7d, 0xa, 0xa, 0};
 
+static const char hdr_style_css[] =
+	"HTTP/1.0 200 OK\r\nServer: uIP/1.0 http://www.sics.se/~adam/uip/\r\nConnection: close\r\nContent-Length: 1015\r\nContent-type: text/css\r\n\r\n";
+
+static const u16_t sum_style_css[] = {
+	0xdd95, };
+
 static const unsigned char data_tcp_shtml[] = {
 	/* /tcp.shtml */
 	0x2f, 0x74, 0x63, 0x70, 0x2e, 0x73, 0x68, 0x74, 0x6d, 0x6c, 0,
@@ -471,6 +507,9 @@ static const unsigned char data_tcp_shtml[] = {
 	0x6f, 0x6f, 0x74, 0x65, 0x72, 0x2e, 0x68, 0x74, 0x6d, 0x6c, 
 0};
 
+static const char hdr_tcp_shtml[] =
+	"HTTP/1.0 200 OK\r\nServer: uIP/1.0 http://www.sics.se/~adam/uip/\r\nConnection: close\r\nContent-type: text/html\r\n\r\n";
+
 static const unsigned char data_fade_png[] = {
 	/* /fade.png */
 	0x2f, 0x66, 0x61, 0x64, 0x65, 0x2e, 0x70, 0x6e, 0x67, 0,
@@ -495,6 +534,12 @@ static const unsigned char data_fade_png[] = {
 	0xa1, 0xf3, 0xfc, 0x73, 00, 00, 00, 00, 0x49, 0x45, 
 	0x4e, 0x44, 0xae, 0x42, 0x60, 0x82, 0};
 
+static const char hdr_fade_png[] =
+	"HTTP/1.0 200 OK\r\nServer: uIP/1.0 http://www.sics.se/~adam/uip/\r\nConnection: close\r\nContent-Length: 197\r\nContent-type: image/png\r\n\r\n";
+
+static const u16_t sum_fade_png[] = {
+	0xfa26, };
+
 static const unsigned char data_stats_shtml[] = {
 	/* /stats.shtml */
 	0x2f, 0x73, 0x74, 0x61, 0x74, 0x73, 0x2e, 0x73, 0x68, 0x74, 0x6d, 0x6c, 0,
@@ -582,26 +627,31 @@ static const unsigned char data_stats_shtml[] = {
 	0x6f, 0x6f, 0x74, 0x65, 0x72, 0x2e, 0x68, 0x74, 0x6d, 0x6c, 
 	0xa, 0};
 
-const struct httpd_fsdata_file file_processes_shtml[] = {{NULL, data_processes_shtml, data_processes_shtml + 17, sizeof(data_processes_shtml) - 17}};
+static const char hdr_stats_shtml[] =
+	"HTTP/1.0 200 OK\r\nServer: uIP/1.0 http://www.sics.se/~adam/uip/\r\nConnection: close\r\nContent-type: text/html\r\n\r\n";
 
-const struct httpd_fsdata_file file_404_html[] = {{file_processes_shtml, data_404_html, data_404_html + 10, sizeof(data_404_html) - 10}};
+const struct httpd_fsdata_file file_processes_shtml[] = {{NULL, data_processes_shtml, data_processes_shtml + 17, sizeof(data_processes_shtml) - 17, hdr_processes_shtml, sizeof(hdr_processes_shtml) - 1, NULL}};
 
-const struct httpd_fsdata_file file_files_shtml[] = {{file_404_html, data_files_shtml, data_files_shtml + 13, sizeof(data_files_shtml) - 13}};
+const struct httpd_fsdata_file file_404_html[] = {{file_processes_shtml, data_404_html, data_404_html + 10, sizeof(data_404_html) - 10, hdr_404_html, sizeof(hdr_404_html) - 1, sum_404_html}};
 
-const struct httpd_fsdata_file file_footer_html[] = {{file_files_shtml, data_footer_html, data_footer_html + 13, sizeof(data_footer_html) - 13}};
+const struct httpd_fsdata_file file_files_shtml[] = {{file_404_html, data_files_shtml, data_files_shtml + 13, sizeof(data_files_shtml) - 13, hdr_files_shtml, sizeof(hdr_files_shtml) - 1, NULL}};
 
-const struct httpd_fsdata_file file_header_html[] = {{file_footer_html, data_header_html, data_header_html + 13, sizeof(data_header_html) - 13}};
+const struct httpd_fsdata_file file_footer_html[] = {{file_files_shtml, data_footer_html, data_footer_html + 13, sizeof(data_footer_html) - 13, hdr_footer_html, sizeof(hdr_footer_html) - 1, sum_footer_html}};
 
-const struct httpd_fsdata_file file_index_html[] = {{file_header_html, data_index_html, data_index_html + 12, sizeof(data_index_html) - 12}};
+const struct httpd_fsdata_file file_header_html[] = {{file_footer_html, data_header_html, data_header_html + 13, sizeof(data_header_html) - 13, hdr_header_html, sizeof(hdr_header_html) - 1, sum_header_html}};
 
-const struct httpd_fsdata_file file_style_css[] = {{file_index_html, data_style_css, data_style_css + 11, sizeof(data_style_css) - 11}};
+const struct httpd_fsdata_file file_index_html[] = {{file_header_html, data_index_html, data_index_html + 12, sizeof(data_index_html) - 12, hdr_index_html, sizeof(hdr_index_html) - 1, sum_index_html}};
 
-const struct httpd_fsdata_file file_tcp_shtml[] = {{file_style_css, data_tcp_shtml, data_tcp_shtml + 11, sizeof(data_tcp_shtml) - 11}};
+const struct httpd_fsdata_file file_style_css[] = {{file_index_html, data_style_css, data_style_css + 11, sizeof(data_style_css) - 11, hdr_style_css, sizeof(hdr_style_css) - 1, sum_style_css}};
 
-const struct httpd_fsdata_file file_fade_png[] = {{file_tcp_shtml, data_fade_png, data_fade_png + 10, sizeof(data_fade_png) - 10}};
+const struct httpd_fsdata_file file_tcp_shtml[] = {{file_style_css, data_tcp_shtml, data_tcp_shtml + 11, sizeof(data_tcp_shtml) - 11, hdr_tcp_shtml, sizeof(hdr_tcp_shtml) - 1, NULL}};
 
-const struct httpd_fsdata_file file_stats_shtml[] = {{file_fade_png, data_stats_shtml, data_stats_shtml + 13, sizeof(data_stats_shtml) - 13}};
+const struct httpd_fsdata_file file_fade_png[] = {{file_tcp_shtml, data_fade_png, data_fade_png + 10, sizeof(data_fade_png) - 10, hdr_fade_png, sizeof(hdr_fade_png) - 1, sum_fade_png}};
+
+const struct httpd_fsdata_file file_stats_shtml[] = {{file_fade_png, data_stats_shtml, data_stats_shtml + 13, sizeof(data_stats_shtml) - 13, hdr_stats_shtml, sizeof(hdr_stats_shtml) - 1, NULL}};
 
 #define HTTPD_FS_ROOT file_stats_shtml
 
 #define HTTPD_FS_NUMFILES 10
+
+#define HTTPD_FS_CHKSUM_MSS 1646
@@ -42,6 +42,9 @@ struct httpd_fsdata_file {
   const char *name;
   const char *data;
   const int len;
+  const char *hdr;
+  const int hdrlen;
+  const u16_t *chksum;
 #ifdef HTTPD_FS_STATISTICS
 #if HTTPD_FS_STATISTICS == 1
   u16_t count;
@@ -54,6 +57,9 @@ struct httpd_fsdata_file_noconst {
   char *name;
   char *data;
   int len;
+  char *hdr;
+  int hdrlen;
+  u16_t *chksum;
 #ifdef HTTPD_FS_STATISTICS
 #if HTTPD_FS_STATISTICS == 1
   u16_t count;
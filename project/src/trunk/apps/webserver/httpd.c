@@ -89,6 +89,17 @@ static unsigned short generate_part_of_file(void *state)
 
     memcpy(uip_appdata, s->file.data, s->len);
 
+    if(s->file.chksum != NULL) {
+	if(uip_mss() == UIP_TCP_MSS || s->len == s->file.len) {
+	    /* The segment is the one makefsdata summed, let uIP reuse it. */
+	    uip_send_chksum(uip_appdata, s->len, *s->file.chksum);
+	} 
+	else {
+	    /* Smaller peer MSS, segments no longer match the stored sums. */
+	    s->file.chksum = NULL;
+	}
+    }
+
     return s->len;
 }
 /*---------------------------------------------------------------------------*/
@@ -100,6 +111,9 @@ static PT_THREAD(send_file(struct httpd_state *s))
 	PSOCK_GENERATOR_SEND(&s->sout, generate_part_of_file, s);
 	s->file.len -= s->len;
 	s->file.data += s->len;
+	if(s->file.chksum != NULL) {
+	    ++s->file.chksum;
+	}
     } while(s->file.len > 0);
 
     PSOCK_END(&s->sout);
@@ -189,6 +203,12 @@ static PT_THREAD(send_headers(struct httpd_state *s, const char *statushdr))
 
     PSOCK_BEGIN(&s->sout);
 
+    if(s->file.hdr != NULL) {
+	/* Complete header generated by makefsdata, status included. */
+	PSOCK_SEND(&s->sout, s->file.hdr, s->file.hdrlen);
+	PSOCK_EXIT(&s->sout);
+    }
+
     PSOCK_SEND_STR(&s->sout, statushdr);
 
     ptr = strrchr(s->filename, ISO_period);
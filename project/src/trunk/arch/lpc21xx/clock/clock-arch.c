@@ -40,6 +40,10 @@
 
 #include "clock-arch.h"
 #include "type.h"
+#include "io.h"
+#include "trace.h"
+#include "lcd.h"
+#include "work.h"
 
 uint64_t tick;
 
@@ -50,6 +54,8 @@ clock_time_t clock_time(void);
 // define periodic task performed using fiq in timer-arch
 void timer0_periodic_task() {
 	++tick;
+	lcdRefresh();
+	workPost(WORK_TICK);
 }
 
 
@@ -67,3 +73,33 @@ clock_time_t clock_time()
   return ((clock_time_t)tick);
 }
 
+/*--------------------------- trace_clock --------------------------------*/
+
+/* Timer 0 counts PCLK */
+const DWORD trace_clock_hz = TIMER0_PCLK_HZ;
+
+DWORD trace_clock(void)
+{
+  DWORD t, count;
+
+  do {
+    t = (DWORD)tick;
+    count = T0TC;
+  } while (t != (DWORD)tick);   /* The timer wrapped in between */
+
+  return t * (T0MR0 + 1) + count;
+}
+
+uint64_t trace_clock64(void)
+{
+  uint64_t t;
+  DWORD count;
+
+  do {
+    t = *(volatile uint64_t *)&tick;
+    count = T0TC;
+  } while (t != *(volatile uint64_t *)&tick);
+
+  return t * (T0MR0 + 1) + count;
+}
+
@@ -40,4 +40,10 @@ typedef unsigned int clock_time_t;
 
 #define CLOCK_CONF_SECOND 1000
 
+/* The tick is really 0.5ms, CLOCK_SECOND ticks are half a second.
+   Delays a part needs use CLOCK_MS(): enough ticks for at least ms
+   milliseconds, the one already started not counting. */
+#define CLOCK_TICK_HZ (TIMER0_PCLK_HZ / TIMER0_PERIOD)
+#define CLOCK_MS(ms) (((ms) * CLOCK_TICK_HZ + 999) / 1000 + 1)
+
 #endif /* __CLOCK_ARCH_H__ */
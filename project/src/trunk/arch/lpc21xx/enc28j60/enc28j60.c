@@ -45,12 +45,27 @@ www.braintechnology.de
 #include "lpc214x.h"
 
 #include "busywait.h"
+#include "timer.h"
 #include "../spi_eth/spi.h"
 #include "enc28j60.h"
 
 uint8_t Enc28j60Bank;
 uint16_t NextPacketPtr;
 
+// Bring-up stages of enc28j60_init_poll()
+#define ENC_WAIT_CLKRDY	    0
+#define ENC_WAIT_SETTLE	    1
+#define ENC_READY	    2
+#define ENC_FAILED	    3
+
+#define ENC_CLKRDY_TIMEOUT  CLOCK_MS(5000)
+#define ENC_SETTLE	    CLOCK_MS(20)
+
+static struct timer initTimer;
+static uint8_t initState = ENC_FAILED;
+
+static void enc28j60_configure(void);
+
 #define CS_ETHERNET	    13
 #define RESET_ETHERNET	    12
 #define INTR_ETHERNET	    14
@@ -150,8 +165,13 @@ uint16_t enc28j60_read16(uint8_t address)
 
 void enc28j60_init(void)
 {
-    uint32_t waits;
+    enc28j60_init_start();
+    while(enc28j60_init_poll() == ENC28J60_BUSY)
+	;
+}
 
+void enc28j60_init_start(void)
+{
     // Init busywait mechanism
     busywaitInit();
 
@@ -190,59 +210,60 @@ void enc28j60_init(void)
 
     ETH_RESET_HIGH();
     ETH_CS_HIGH();
-    //  Give the part 1 second for the PHY to become ready (CLKRDY == 1).  If it
-    //  doesn't, return an error to the user. 
-    //
-    //  Note that we also check that bit 3 is 0.  The data sheet says this is
-    //  unimplemented and will return 0.  We use this as a sanity check for the
-    //  ENC28J60 actually being present, because the MISO line typically floats
-    //  high.  If we only checked the CLKRDY, it will likely return 1 for when no
-    //  ENC28J60 is present.
-    //
     pmesg(MSG_DEBUG, "Waiting for phy to become ready\n");
-    waits = 0;
-    while ( ((enc28j60_read(ESTAT) & (ESTAT_UNIMP | ESTAT_CLKRDY)) != ESTAT_CLKRDY) )
+    timer_set(&initTimer, ENC_CLKRDY_TIMEOUT);
+    initState = ENC_WAIT_CLKRDY;
+}
+
+int enc28j60_init_poll(void)
+{
+    switch(initState)
     {
-	if(waits >= 10)
+    case ENC_WAIT_CLKRDY:
+	//  Give the part 5 seconds for the PHY to become ready (CLKRDY == 1).  If it
+	//  doesn't, return an error to the user. 
+	//
+	//  Note that we also check that bit 3 is 0.  The data sheet says this is
+	//  unimplemented and will return 0.  We use this as a sanity check for the
+	//  ENC28J60 actually being present, because the MISO line typically floats
+	//  high.  If we only checked the CLKRDY, it will likely return 1 for when no
+	//  ENC28J60 is present.
+	//
+	if((enc28j60_read(ESTAT) & (ESTAT_UNIMP | ESTAT_CLKRDY)) != ESTAT_CLKRDY)
 	{
+	    if(!timer_expired(&initTimer))
+		return ENC28J60_BUSY;
 	    pmesg(MSG_CRIT, "PHY ERROR !\n");
-	    return;
+	    initState = ENC_FAILED;
+	    break;
 	}
-	waits++;
-	busywait(500 * MS2MICROSEC);
+	pmesg(MSG_DEBUG, "phy wait ended");
+
+	// Perform system reset
+	//    Wake up
+	enc28j60_write_op(ENC28J60_BIT_FIELD_CLR, 
+		ECON2, 
+		ECON2_PWRSV);
+
+	// According to Errata workaround #2, CLKRDY check is unreliable, delay 20ms instead
+	timer_set(&initTimer, ENC_SETTLE);
+	initState = ENC_WAIT_SETTLE;
+	return ENC28J60_BUSY;
+
+    case ENC_WAIT_SETTLE:
+	if(!timer_expired(&initTimer))
+	    return ENC28J60_BUSY;
+	pmesg(MSG_DEBUG, "System Soft Reset\n");
+	enc28j60_configure();
+	initState = ENC_READY;
+	break;
     }
-    waits = 0;
-    //fflush(stdout);
-    pmesg(MSG_DEBUG, "phy wait ended");
-    //fflush(stdout);
-
-    // Soft reset
-    //ETH_CS_LOW();
-    //ETH_SPI(0xff);
-    //ETH_CS_HIGH();
-
-    busywait(20 * MS2MICROSEC);
 
-    // Perform system reset
-    //    Wake up
-    enc28j60_write_op(ENC28J60_BIT_FIELD_CLR, 
-	    ECON2, 
-	    ECON2_PWRSV);
-    //    Reset
-    //enc28j60_write_op(ENC28J60_SOFT_RESET, 0, ENC28J60_SOFT_RESET);
-
-    // According to Errata workaround #2, CLKRDY check is unreliable, delay 20ms instead
-    busywait(20 * MS2MICROSEC);
-    pmesg(MSG_DEBUG, "System Soft Reset\n");
-#if 0
-    for(i = 0; i < 10; i++)
-    {
-	TRACE("1 sec...");
-        busywait(1000 * MS2MICROSEC);
-	TRACE("ended");
-    }
-#endif
+    return initState == ENC_READY ? ENC28J60_READY : ENC28J60_FAILED;
+}
 
+static void enc28j60_configure(void)
+{
     // Automatically increment ERDPT or EWRPT on reading from or writing to EDATA
     enc28j60_write_op(ENC28J60_BIT_FIELD_SET,
 	    ECON2,
@@ -595,6 +616,7 @@ unsigned int enc28j60_packet_receive(uint32_t maxlen, uint8_t *packet)
     //    Read rest of the receive status (ignored)
     rxstat  = enc28j60_read_op(ENC28J60_READ_BUF_MEM, 0);
     rxstat |= enc28j60_read_op(ENC28J60_READ_BUF_MEM, 0) << 8;
+    TRACE_EV(TEV_RX, len, rxstat);
 
     //  If the frame is too big to handle, throw it away
     if (len > maxlen)
@@ -315,6 +315,17 @@
 //! Initialize the ethernet device
 void enc28j60_init(void);
 
+//! Staged initialization, for a boot that does other things meanwhile.
+/// enc28j60_init_start() releases the reset, then enc28j60_init_poll() is
+/// called until it stops returning ENC28J60_BUSY; it never waits itself.
+/// \return ENC28J60_READY, ENC28J60_BUSY or ENC28J60_FAILED (no chip found).
+void enc28j60_init_start(void);
+int enc28j60_init_poll(void);
+
+#define ENC28J60_READY	0
+#define ENC28J60_BUSY	1
+#define ENC28J60_FAILED	2
+
 //! Packet receive function.
 /// Gets a packet from the network receive buffer, if one is available.
 /// The packet will by headed by an ethernet header.
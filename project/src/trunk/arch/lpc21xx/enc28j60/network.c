@@ -37,6 +37,16 @@ void network_init(void)
     enc28j60_init();
 }
 
+void network_init_start(void)
+{
+    enc28j60_init_start();
+}
+
+int network_init_poll(void)
+{
+    return enc28j60_init_poll() == ENC28J60_BUSY;
+}
+
 unsigned int network_read(void *pPacket)
 {
     return enc28j60_packet_receive(1500, pPacket);
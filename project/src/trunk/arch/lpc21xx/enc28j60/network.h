@@ -42,6 +42,11 @@
 
 void network_init(void);
 
+/* network_init() in two steps: network_init_poll() returns nonzero
+   while the controller is still starting, without waiting for it. */
+void network_init_start(void);
+int network_init_poll(void);
+
 unsigned int network_read(void *packet);
 void network_send(void *pPacket, unsigned int size);
 
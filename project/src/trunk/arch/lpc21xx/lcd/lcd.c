@@ -1,4 +1,6 @@
 #include "lcd.h"
+#include "boot.h"
+#include "clock.h"
 #include <string.h>
 
 #define max(a,b) ((((int)a)>((int)b)) ? (a) : (b))
@@ -243,63 +245,175 @@ void write(int bits) {
 	}
 }
 
-/* LCD API */
+/* Frame buffer */
 
-void lcdPrintChar(char c) {
-	write(c);
-}
+/* DDRAM address of a character cell */
+#define LCD_ADDR(row, col) ((row) * 0x40 + (col))
+#define LCD_CELLS (LCD_ROWS * LCD_LINE)
 
-void lcdGoto(int dest_addr) {
-	int busy;
-	int addr;
-	int delta;
-	int direction = RIGHT;
+#define LCD_POWER_TICKS CLOCK_MS(40)	/* From power-on, 2.7V supply */
+#define LCD_CLEAR_TICKS CLOCK_MS(2)	/* A clear takes 1.52ms */
 
+/* Controller setup: function set 8 bit, display on with blink, clear,
+   increment. */
+static const unsigned char initCmds[] = { 0x38, 0x0F, 0x01, 0x06 };
+static int initStep;		/* Next of initCmds[] to send */
+static int initWait;		/* Ticks to let pass before it */
+
+static char fb[LCD_ROWS][LCD_LINE];	/* What the display should show */
+static char shown[LCD_ROWS][LCD_LINE];	/* What it shows */
+static int fbRow, fbCol;		/* Cursor of the writers */
+static volatile int fbShift;		/* Display shift wanted */
+static volatile int fbDirty;		/* fb may differ from shown */
+
+static int shownShift;
+static int hwAddr;		/* Address counter of the controller */
+static int scanPos;		/* Next cell the refresh compares */
+static int nibbleRs = -1;	/* 4 bit mode: low nibble due, with RS */
+static int nibbleBits;
+static volatile int refreshOn;
+
+/*
+ * One write cycle without the busy flag: the refresh runs once per
+ * timer tick, longer than the controller takes for anything but a clear.
+ */
+static void strobe(int rs, int bits)
+{
+	volatile int i;
+
+	if (rs)
+		lcd_rs_set();
+	else
+		lcd_rs_clear();
+	lcd_data8_set(bits);
+	lcd_en_set();
+	/* Clock pulse width */
+	for (i = 0; i < 2; i++)
+		;
+	lcd_en_clear();
+}
+
+static void busWrite(int rs, int bits)
+{
 	if (g_is8bit) {
-		read8(&busy, &addr);
+		strobe(rs, bits);
 	}
 	else {
-		read4(&busy, &addr);
+		strobe(rs, bits & 0xF0);
+		nibbleRs = rs;
+		nibbleBits = (bits << 4) & 0xF0;
 	}
+}
 
-	delta = dest_addr - addr;
+/*
+ * Called from the timer tick: one bus cycle towards the frame buffer.
+ * Changed cells go out in address order, an address set only where
+ * they are not contiguous, then the display shift follows.
+ */
+void lcdRefresh(void)
+{
+	int i, row, col;
 
-	if (delta < 0)
-	{
-		delta = -delta;
-		direction = LEFT;
+	if (!refreshOn)
+		return;
+	if (nibbleRs >= 0) {
+		strobe(nibbleRs, nibbleBits);
+		nibbleRs = -1;
+		return;
+	}
+	if (initWait > 0) {
+		initWait--;
+		return;
+	}
+	if (initStep < (int)sizeof(initCmds)) {
+		busWrite(0, initCmds[initStep]);
+		if (initCmds[initStep] == 0x01)
+			initWait = LCD_CLEAR_TICKS;
+		if (++initStep == (int)sizeof(initCmds))
+			bootMark(BOOT_LCD);
+		return;
 	}
+	if (!fbDirty)
+		return;
 
-	for(int i = 0; i < delta; i++) 
-	{
-		inst(CURSOR_DISP_SHIFT | direction);
+	for (i = 0; i < LCD_CELLS; i++) {
+		row = scanPos / LCD_LINE;
+		col = scanPos % LCD_LINE;
+		if (fb[row][col] != shown[row][col])
+			break;
+		scanPos = (scanPos + 1) % LCD_CELLS;
 	}
+
+	if (i == LCD_CELLS) {
+		if (shownShift < fbShift) {
+			busWrite(0, CURSOR_DISP_SHIFT | 0x08 | LEFT);
+			shownShift++;
+		}
+		else if (shownShift > fbShift) {
+			busWrite(0, CURSOR_DISP_SHIFT | 0x08 | RIGHT);
+			shownShift--;
+		}
+		else {
+			fbDirty = 0;
+		}
+		return;
+	}
+
+	if (hwAddr != LCD_ADDR(row, col)) {
+		hwAddr = LCD_ADDR(row, col);
+		busWrite(0, 0x80 | hwAddr);
+		return;
+	}
+
+	shown[row][col] = fb[row][col];
+	busWrite(1, shown[row][col]);
+	if (col + 1 < LCD_LINE)
+		hwAddr++;
+	else
+		hwAddr = LCD_ADDR((row + 1) % LCD_ROWS, 0);
+	scanPos = (scanPos + 1) % LCD_CELLS;
+}
+
+/* LCD API */
+
+void lcdPrintChar(char c) {
+	if (fbCol < LCD_LINE)
+		fb[fbRow][fbCol++] = c;
+	fbDirty = 1;
+}
+
+void lcdGoto(int dest_addr) {
+	fbRow = (dest_addr >= 0x40);
+	fbCol = dest_addr & 0x3F;
+	if (fbCol > LCD_LINE)
+		fbCol = LCD_LINE;
 }
 
 void lcdPrintString(char *str) 
 {
-	int tok = strlen(str);
-	for (int i = 0; i < strlen(str); ++i)
+	int len = 0;
+	int longest = 0;
+
+	for (; *str; str++)
 	{
-		char c = str[i];
-		if (c == '\n') {
-			inst(0xC0);
-			tok = i;
+		if (*str == '\n') {
+			lcdGoto(LCD_ADDR(1, 0));
+			len = 0;
 		}
 		else {
-			lcdPrintChar(c);
+			lcdPrintChar(*str);
+			len++;
 		}
+		longest = max(longest, len);
 	}
 
-	if ((tok > 16) || (strlen(str) - tok > 16))
+	/* Scroll the end of a long line into view */
+	if (longest > LCD_COLS)
 	{
-		lcdbusywait(10000);
-		for (int j = 0; j < max(strlen(str) - tok - 16, tok - 16); j++)
-		{
-			inst(0x18);
-			lcdbusywait(1000);
-		}
-
+		fbShift = longest - LCD_COLS;
+		if (fbShift > LCD_LINE - LCD_COLS)
+			fbShift = LCD_LINE - LCD_COLS;
+		fbDirty = 1;
 	}
 }
 
@@ -320,27 +434,31 @@ void set_bitmode(int mode)
 
 void lcdClearScreen()
 {
-	inst(0x01); 
+	memset(fb, ' ', sizeof(fb));
+	fbRow = fbCol = 0;
+	fbShift = 0;
+	fbDirty = 1;
 }
 
 void lcdInit() 
 {
+	refreshOn = 0;
 	lcd_en_rs_out();
 	lcd_data8_out();
 	lcd_rw_out(); 
+	lcd_rw_clear();
 	lcd_backlight_on(); 
 
-	/* Function Set 1 line  */
-	inst(0x38);
-
-	/* Display on, Blink */
-	inst(0x0F);
-
-	/* Clear Screen*/ 
+	/* From here on the timer tick drives the display, the setup and
+	   its clear first */
+	initStep = 0;
+	initWait = LCD_POWER_TICKS;
+	memset(shown, ' ', sizeof(shown));
+	shownShift = 0;
+	hwAddr = 0;
+	nibbleRs = -1;
 	lcdClearScreen();
-
-	/* Increment */
-	inst(0x06);
+	refreshOn = 1;
 
 	return;
 }
@@ -10,11 +10,26 @@
 #define RIGHT 0x4
 #define CURSOR_DISP_SHIFT 0x10
 
+/* Display RAM: 2 lines of 40 characters, 16 of them visible */
+#define LCD_ROWS 2
+#define LCD_LINE 40
+#define LCD_COLS 16
+
 #define lcd_backlight_on() { IODIR0 |= BIT30; \
 	IOSET0 = BIT30; }
 #define lcd_backlight_off() { IODIR0 &= ~BIT30; \
 	IOCLR0 = BIT30; }
 
+/* lcdPrintChar(), lcdGoto(), lcdPrintString() and lcdClearScreen() only
+   change a frame buffer in RAM and return. lcdRefresh(), called on every
+   timer tick, brings the display in line with it: one bus cycle per
+   tick (a character or an address, a nibble of them in 4 bit mode),
+   changed characters only. A tick is longer than any command but a
+   clear, which the refresh never sends, so it never waits for the
+   busy flag.
+   lcdInit() returns at once as well: the refresh sends the controller
+   setup first, after the power-on time, and then marks BOOT_LCD. The
+   timer must be running (clock_init()) for the display to come up. */
 void lcdPrintChar(char c);
 
 void lcdGoto(int dest_addr);
@@ -27,6 +42,8 @@ void lcdInit();
 
 void lcdClearScreen();
 
+void lcdRefresh(void);
+
 void busywait(uint64_t microseconds);
 
 #endif
@@ -8,6 +8,8 @@ BYTE MMCRDData[MMC_DATA_SIZE];
 BYTE MMCCmd[MMC_CMD_SIZE]; 
 BYTE MMCCSD[16];
 BYTE MMCStatus = 0; 
+DWORD MMCWait;          /* Bytes polled for the card by the last block command */
+BYTE MMCBusy = 0;       /* Card still programming the last mmc_write_start() block */
 
 /************************** MMC Init *********************************/ 
 /* 
@@ -19,6 +21,35 @@ int mmc_init()
 { 
   DWORD i; 
  
+  if( mmc_init_start() != 0 ) 
+  { 
+    return MMCStatus; 
+  } 
+ 
+  /* must keep sending command until zero response ia back. */ 
+  for( i = MAX_TIMEOUT; i > 0; i-- ) 
+  { 
+    if( mmc_init_poll() != MMC_INIT_BUSY ) 
+    { 
+      return MMCStatus; 
+    } 
+  } 
+ 
+  /* timeout waiting for 0x00 from the MMC */ 
+  MMCStatus = OP_COND_TIMEOUT; 
+  return MMCStatus; 
+} 
+ 
+/* 
+ * First half of mmc_init(): SPI mode and GO_IDLE_STATE. The card then 
+ * takes up to a second of its own to leave the idle state, polled by 
+ * mmc_init_poll() with one SEND_OP_COND each call. Returns 0 on success. 
+ * 
+ */ 
+int mmc_init_start(void) 
+{ 
+  DWORD i; 
+ 
   /* Generate a data pattern for write block */ 
   for(i=0;i<MMC_DATA_SIZE;i++) 
   { 
@@ -26,6 +57,7 @@ int mmc_init()
   } 
  
   MMCStatus = 0; 
+  MMCBusy = 0;      /* A write in progress is lost with the reset */ 
   IOSET0 = SPI_SEL; /* set SPI SSEL */ 
  
   /* initialise the MMC card into SPI mode by sending 80 clks on */ 
@@ -61,29 +93,35 @@ int mmc_init()
   SSP_SendRecvByteByte(); 
   IOCLR0 = SPI_SEL; /* clear SPI SSEL */ 
    
-  /* must keep sending command until zero response ia back. */ 
-  i = MAX_TIMEOUT; 
-  do  
-  { 
-    /* send mmc CMD1(SEND_OP_COND) to bring out of idle state */ 
-    /* all the arguments are 0x00 for command one */ 
-    MMCCmd[0] = 0x41; 
-    MMCCmd[1] = 0x00; 
-    MMCCmd[2] = 0x00; 
-    MMCCmd[3] = 0x00; 
-    MMCCmd[4] = 0x00; 
-    /* checksum is no longer required but we always send 0xFF */ 
-    MMCCmd[5] = 0xFF; 
-    SPI_Send( MMCCmd, MMC_CMD_SIZE ); 
-   i--; 
-  } while ( (mmc_response(0x00) != 0) && (i>0) ); 
+  return 0; 
+} 
  
-  /* timeout waiting for 0x00 from the MMC */ 
-  if ( i == 0 ) 
+/* 
+ * Second half of mmc_init(): MMC_INIT_BUSY while the card is still in 
+ * its idle state, else 0 with the block size set, or an error. 
+ * 
+ */ 
+int mmc_init_poll(void) 
+{ 
+  IOCLR0 = SPI_SEL; /* clear SPI SSEL */ 
+ 
+  /* send mmc CMD1(SEND_OP_COND) to bring out of idle state */ 
+  /* all the arguments are 0x00 for command one */ 
+  MMCCmd[0] = 0x41; 
+  MMCCmd[1] = 0x00; 
+  MMCCmd[2] = 0x00; 
+  MMCCmd[3] = 0x00; 
+  MMCCmd[4] = 0x00; 
+  /* checksum is no longer required but we always send 0xFF */ 
+  MMCCmd[5] = 0xFF; 
+  SPI_Send( MMCCmd, MMC_CMD_SIZE ); 
+ 
+  if( mmc_response(0x00) != 0 ) 
   { 
-    MMCStatus = OP_COND_TIMEOUT; 
     IOSET0 = SPI_SEL; /* set SPI SSEL */ 
-   return MMCStatus; 
+    SSP_SendRecvByteByte(); 
+    MMCStatus = MMC_INIT_BUSY; 
+    return MMCStatus; 
   } 
  
   /* Send some dummy clocks after SEND_OP_COND */ 
@@ -119,6 +157,7 @@ int mmc_init()
   
 
   // Finish initialization with get_csd() command.
+  MMCStatus = 0; 
   return 0;//mmc_get_csd(); 
 } 
  
@@ -133,25 +172,43 @@ int mmc_init()
  * that MMC card is in idle state again. 
  *   
  */ 
-int mmc_write_block(WORD block_number) 
+int mmc_write_block(DWORD block_number) 
 { 
-  WORD varl, varh; 
+  int res; 
+ 
+  res = mmc_write_start(block_number); 
+  if (res == 0) 
+    res = mmc_write_finish(); 
+  return res; 
+} 
+ 
+/************************** MMC Write Start ***************************/ 
+/* 
+ * Same as mmc_write_block(), but returns as soon as the card has  
+ * accepted the data. The card then programs the block on its own  
+ * with the select line high, mmc_write_finish() waits for it. 
+ * 
+ */ 
+int mmc_write_start(DWORD block_number) 
+{ 
+  DWORD addr; 
   BYTE Status; 
  
+  if (mmc_write_finish() != 0) 
+   return MMCStatus; 
+ 
+  MMCWait = 0; 
   IOCLR0 = SPI_SEL; /* clear SPI SSEL */ 
    
-  /* block size has been set in mmc_init() */ 
-  varl=((block_number&0x007F)<<9); 
-  varh=((block_number&0xFF80)>>7); 
+  /* block size has been set in mmc_init(), the address is in bytes */ 
+  addr = block_number << 9; 
  
   /* send mmc CMD24(WRITE_SINGLE_BLOCK) to write the data to MMC card */ 
   MMCCmd[0] = 0x58; 
-  /* high block address bits, varh HIGH and LOW */ 
-  MMCCmd[1] = varh >> 0x08; 
-  MMCCmd[2] = varh & 0xFF; 
-  /* low block address bits, varl HIGH and LOW */ 
-  MMCCmd[3] = varl >> 0x08; 
-  MMCCmd[4] = varl & 0xFF; 
+  MMCCmd[1] = addr >> 24; 
+  MMCCmd[2] = addr >> 16; 
+  MMCCmd[3] = addr >> 8; 
+  MMCCmd[4] = addr; 
   /* checksum is no longer required but we always send 0xFF */ 
   MMCCmd[5] = 0xFF; 
   SPI_Send(MMCCmd, MMC_CMD_SIZE ); 
@@ -187,17 +244,40 @@ int mmc_write_block(WORD block_number)
    return MMCStatus; 
   } 
  
-  /* if the status is already zero, the write hasn't finished 
-  yet and card is busy */  
-  if(mmc_wait_for_write_finish()==1) 
+  /* the card is busy programming the block now, it keeps on 
+  with the select line high */ 
+  MMCBusy = 1; 
+  IOSET0 = SPI_SEL;      /* set SPI SSEL */ 
+  SSP_SendRecvByteByte(); 
+  return 0; 
+} 
+ 
+/************************** MMC Write Finish **************************/ 
+/* 
+ * Waits until the card has programmed the block of the last  
+ * mmc_write_start(). Returns at once if it is not busy, 
+ * WRITE_BLOCK_FAIL if it did not finish in time. 
+ * 
+ */ 
+int mmc_write_finish(void) 
+{ 
+  int res; 
+ 
+  if (!MMCBusy) 
+    return 0; 
+  MMCBusy = 0; 
+ 
+  /* the card shows busy again once selected */ 
+  IOCLR0 = SPI_SEL; /* clear SPI SSEL */ 
+  res = mmc_wait_for_write_finish(); 
+  IOSET0 = SPI_SEL; /* set SPI SSEL */ 
+  SSP_SendRecvByteByte(); 
+ 
+  if (res == 1) 
   { 
     MMCStatus = WRITE_BLOCK_FAIL; 
-    IOSET0 = SPI_SEL;    /* set SPI SSEL */ 
-   return MMCStatus; 
+    return MMCStatus; 
   } 
- 
-  IOSET0 = SPI_SEL;      /* set SPI SSEL */ 
-  SSP_SendRecvByteByte(); 
   return 0; 
 } 
  
@@ -209,24 +289,31 @@ int mmc_write_block(WORD block_number)
  * block back followed by the checksum. 
  * 
  */ 
-int mmc_read_block(WORD block_number) 
+int mmc_read_block(DWORD block_number) 
+{ 
+  return mmc_read_block_to(block_number, MMCRDData); 
+} 
+ 
+/* As mmc_read_block(), into buf instead of MMCRDData */ 
+int mmc_read_block_to(DWORD block_number, BYTE *buf) 
 { 
   WORD Checksum; 
-  WORD varh,varl; 
+  DWORD addr; 
+ 
+  if (mmc_write_finish() != 0) 
+   return MMCStatus; 
  
+  MMCWait = 0; 
   IOCLR0 = SPI_SEL; /* clear SPI SSEL */ 
  
-  varl=((block_number&0x007F)<<9); 
-  varh=((block_number&0xFF80)>>7); 
+  addr = block_number << 9; 
  
   /* send MMC CMD17(READ_SINGLE_BLOCK) to read the data from MMC card */ 
   MMCCmd[0] = 0x51; 
-  /* high block address bits, varh HIGH and LOW */ 
-  MMCCmd[1] = varh >> 0x08;
-  MMCCmd[2] = varh & 0xFF; 
-  /* low block address bits, varl HIGH and LOW */ 
-  MMCCmd[3] = varl >> 0x08; 
-  MMCCmd[4] = varl & 0xFF; 
+  MMCCmd[1] = addr >> 24; 
+  MMCCmd[2] = addr >> 16; 
+  MMCCmd[3] = addr >> 8; 
+  MMCCmd[4] = addr; 
   /* checksum is no longer required but we always send 0xFF */ 
   MMCCmd[5] = 0xFF; 
 
@@ -253,7 +340,7 @@ for (int i = 0; i < 6; i++)
   } 
  
   /* Get the block of data based on the length */ 
-  SSP_SendRecvByte( MMCRDData, MMC_DATA_SIZE ); 
+  SSP_SendRecvByte( buf, MMC_DATA_SIZE ); 
    
   /* CRC bytes that are not needed */ 
   Checksum = SSP_SendRecvByteByte(); 
@@ -283,6 +370,7 @@ int mmc_response( BYTE response)
    } 
    count--; 
   } 
+  MMCWait += 0xFFF - count; 
   if ( count == 0 )    
       return 1;     /* Failure, loop was exited due to timeout */ 
   else 
@@ -290,6 +378,19 @@ int mmc_response( BYTE response)
  
 } 
  
+/***************** MMC idle clocks *******************/ 
+/* 
+ * Clocks the card with the select line high, giving it time to  
+ * recover before a failed command is sent again. 
+ * 
+ */ 
+void mmc_idle( WORD bytes ) 
+{ 
+  IOSET0 = SPI_SEL; /* set SPI SSEL */ 
+  while( bytes-- ) 
+    SSP_SendRecvByteByte(); 
+} 
+ 
 /***************** MMC wait for write finish *******************/ 
 /* 
  * Repeatedly reads the MMC until we get a non-zero value (after  
@@ -300,7 +401,9 @@ int mmc_response( BYTE response)
 int mmc_wait_for_write_finish( void ) 
 { 
   DWORD count = 0xFFFF;   /* The delay is set to maximum considering  
-                        the longest data block length to handle */ 
+                        the longest data block length to handle, 
+                        more than the 250ms write timeout of SD  
+                        cards at SPI clocks up to 2MHz */ 
   BYTE result = 0; 
  
   while( (result == 0) && count ) 
@@ -308,6 +411,7 @@ int mmc_wait_for_write_finish( void )
     result = SSP_SendRecvByteByte(); 
    count--; 
   } 
+  MMCWait += 0xFFFF - count; 
   
     if ( count == 0 )    
       return 1;     /* Failure, loop was exited due to timeout */ 
@@ -325,6 +429,9 @@ int mmc_get_csd()
   BYTE Status; 
   BYTE result;
  
+  if (mmc_write_finish() != 0) 
+   return MMCStatus; 
+ 
   IOCLR0 = SPI_SEL; /* clear SPI SSEL */ 
     
   /* send mmc CMD9(CSD_SEND) to make the card send CSD Register */ 
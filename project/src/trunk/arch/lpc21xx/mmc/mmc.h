@@ -19,14 +19,22 @@
 #define DATA_TOKEN_TIMEOUT         8 
 #define SELECT_CARD_TIMEOUT        9 
 #define SET_RELATIVE_ADDR_TIMEOUT     10 
+#define MMC_INIT_BUSY         0xFF  /* mmc_init_poll(): still idle */ 
 
 
  
 int mmc_init(void); 
+int mmc_init_start(void); 
+int mmc_init_poll(void); 
 int mmc_response(BYTE response); 
-int mmc_read_block(WORD block_number); 
-int mmc_write_block(WORD block_number); 
+int mmc_read_block(DWORD block_number); 
+int mmc_read_block_to(DWORD block_number, BYTE *buf); 
+int mmc_write_block(DWORD block_number); 
+int mmc_write_start(DWORD block_number); 
+int mmc_write_finish(void); 
 int mmc_wait_for_write_finish(void); 
+void mmc_idle(WORD bytes); 
 int mmc_get_csd();
+DWORD mmc_card_capacity(void);
 
 #endif //_MMC_H_
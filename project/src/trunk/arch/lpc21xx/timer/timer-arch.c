@@ -1,5 +1,6 @@
 #include "io.h"
 #include "interrupt.h"
+#include "timer-arch.h"
 
 extern void timer0_periodic_task();
 
@@ -9,7 +10,7 @@ void __attribute__ ((interrupt("FIQ"))) fiq_isr(void) {
 }
 
 void timer0Init() {
-    T0MR0 = 2999;	  /* Count 1 millisecond (1/1000 sec) */
+    T0MR0 = TIMER0_PERIOD - 1;	/* Count 0.5 millisecond */
     T0MCR = BIT0 | BIT1;  /* reset & Interrupt on match */
     T0TCR = BIT0;         /* start timer */
 
@@ -1,6 +1,11 @@
 #ifndef __TIMER_ARCH_H__
 #define __TIMER_ARCH_H__
 
+/* Timer 0 counts PCLK, the 12MHz crystal without PLL and VPBDIV = 2,
+   and interrupts every TIMER0_PERIOD counts: a 0.5ms tick. */
+#define TIMER0_PCLK_HZ	6000000
+#define TIMER0_PERIOD	3000
+
 void timer0Init(void);
 
 extern void timer0_periodic_task(void);
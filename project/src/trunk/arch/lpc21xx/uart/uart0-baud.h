@@ -0,0 +1,6 @@
+/* Generated by mkbaud from uart0.h, do not edit. */
+/* 19200 baud from a 6000000 Hz PCLK: 19176 baud */
+#define UART0_BAUD_PCLK		6000000
+#define UART0_BAUD_FOR		19200
+#define UART0_DIVISOR		16
+#define UART0_FDR		0x92	/* DIVADDVAL 2, MULVAL 9 */
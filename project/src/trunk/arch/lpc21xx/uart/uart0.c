@@ -1,58 +1,148 @@
-#include <math.h>
 #include <reent.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include "uart0.h"
+#include "uart0-baud.h"
 #include "syscalls.h"
+#include "work.h"
+
+#define UART0_INT	BIT6	/* VIC channel */
+#define IIR_THRE	0x02	/* U0IIR interrupt id, transmit FIFO empty */
+#define TX_FIFO		16
+
+static volatile uint8_t txBuf[UART0_TX_BUF];
+static volatile uint16_t txHead;	/* Next free slot, moved by the senders */
+static volatile uint16_t txTail;	/* Next byte to send, moved when sent */
+static volatile uint8_t txIdle = 1;	/* No THRE interrupt to come, kick it */
+static uint32_t txDropped;
+
+/* Move queued bytes to the FIFO, it is empty. */
+static void txFill(void) {
+    int n;
+
+    for (n = 0; n < TX_FIFO && txTail != txHead; n++) {
+	U0THR = txBuf[txTail];
+	txTail = (txTail + 1) % UART0_TX_BUF;
+    }
+    if (n == 0) {
+	txIdle = 1;
+	workPost(WORK_UART);
+    }
+}
+
+static void __attribute__ ((interrupt("IRQ"))) uart0Isr(void) {
+    if ((U0IIR & 0x0F) == IIR_THRE)
+	txFill();
+    VICVectAddr = 0;
+}
 
 uint32_t uart0IsTxBufferEmpty() {
-    return 1;
+    return txHead == txTail && (U0LSR & BIT6);
 }
 
-void uart0Init() {
-    U0LCR = BIT1 | BIT0 /* 8-bit words                            */
-        | BIT7;             /* enable programming of divisor latches  */
+/* Wait until everything queued is out, with or without interrupts. */
+void uart0Flush(void) {
+    while (!uart0IsTxBufferEmpty()) {
+	VICIntEnClr = UART0_INT;
+	if (U0LSR & BIT5)
+	    txFill();
+	VICIntEnable = UART0_INT;
+    }
+}
 
-    {
-        uint32_t divaddval, mulval, divisor;
-        double exact_rate, exact_divisor;
-        double error, min_exact_rate, min_error = 1e300;
-        uint32_t min_divaddval, min_mulval, min_divisor;
-
-        for (divaddval=0; divaddval <= 15; divaddval++) {
-            for (mulval=1; mulval <= 15; mulval++) {
-                exact_divisor = (double) CLOCKS_PCLK / ( (double) UART0_BAUD_RATE
-                        * 16.0 * ( 1.0 + ( (double) divaddval / (double) mulval ) ) );
-                divisor = round(exact_divisor);
-                exact_rate = (double) CLOCKS_PCLK / ( (double) divisor * 16.0 * ( 1.0
-                            + ( (double) divaddval / (double) mulval ) ) );
-                error = fabs(exact_rate - (double) UART0_BAUD_RATE );
-                if (error < min_error) {
-                    min_error = error;
-                    min_exact_rate = exact_rate;
-                    min_divaddval = divaddval;
-                    min_mulval = mulval;
-                    min_divisor = divisor;
-                }
+uint32_t uart0TxDropped(void) {
+    return txDropped;
+}
+
+static void uart0SetDivisor(uint32_t divisor, uint32_t fdr) {
+    U0LCR |= BIT7;      /* enable programming of divisor latches  */
+    U0DLM = (divisor & 0x0000FF00) >> 8;
+    U0DLL = (divisor & 0x000000FF);
+    U0FDR = fdr;
+    U0LCR &= ~BIT7;     /* disable programming of divisor latches */
+}
+
+/* Closest rate the fractional divider gives, in integers: 
+   rate = PCLK / (16 * divisor * (1 + DIVADDVAL / MULVAL)).
+   mkbaud does the same search at build time for UART0_BAUD_RATE. */
+void uart0SetBaud(uint32_t baud) {
+    uint32_t d, m, div, err, best = 0xFFFFFFFF;
+    uint32_t best_div = 1, best_fdr = 0x10;
+
+    for (d = 0; d < 15; d++) {
+        for (m = d + 1; m <= 15; m++) {
+            div = (CLOCKS_PCLK * m + 8 * baud * (m + d)) / (16 * baud * (m + d));
+            if (div < 1 || div > 0xFFFF || (d && div < 3))
+                continue;
+            err = CLOCKS_PCLK * m / (div * (m + d));
+            err = err > 16 * baud ? err - 16 * baud : 16 * baud - err;
+            if (err < best) {
+                best = err;
+                best_div = div;
+                best_fdr = d | (m << 4);
             }
         }
-        U0DLM = (min_divisor & 0x0000FF00) >> 8;
-        U0DLL = (min_divisor & 0x000000FF);
-        U0FDR = min_divaddval | (min_mulval << 4);
     }
+    uart0SetDivisor(best_div, best_fdr);
+}
+
+void uart0Init() {
+    U0LCR = BIT1 | BIT0; /* 8-bit words                            */
 
-    U0LCR &= ~BIT7; /* disable programming of divisor latches */
+#if UART0_BAUD_PCLK == CLOCKS_PCLK && UART0_BAUD_FOR == UART0_BAUD_RATE
+    uart0SetDivisor(UART0_DIVISOR, UART0_FDR);
+#else
+#warning uart0-baud.h is for another rate or clock, run mkbaud
+    uart0SetBaud(UART0_BAUD_RATE);
+#endif
 
     U0FCR = BIT0 | BIT1 | BIT2; /* FIFO control: enable & reset    */
 
     PINSEL0 &= ~(BIT1 | BIT3); /* select UART function               */
     PINSEL0 |= BIT0 | BIT2; /* for pins P0.0 and P0.1             */
+
+    txHead = txTail = 0;
+    txIdle = 1;
+
+    /* Transmit interrupt as vectored IRQ, it runs once main() has
+       enabled the interrupts (clock_init()) */
+    VICIntSelect &= ~UART0_INT;
+    *(&VICVectAddr0 + UART0_VIC_SLOT) = (unsigned long)uart0Isr;
+    *(&VICVectCntl0 + UART0_VIC_SLOT) = BIT5 | 6;
+    U0IER = BIT1;		/* THRE */
+    VICIntEnable = UART0_INT;
 }
 
 void uart0SendByte(uint8_t c) {
-    while (!(U0LSR & BIT5));
-    U0THR = c;
+    uint16_t next = (txHead + 1) % UART0_TX_BUF;
+
+    while (next == txTail) {
+#if UART0_TX_DROP
+	txDropped++;
+	return;
+#else
+	/* The interrupt empties the ring, unless the interrupts are
+	   still off: then feed the FIFO from here */
+	VICIntEnClr = UART0_INT;
+	if (U0LSR & BIT5)
+	    txFill();
+	VICIntEnable = UART0_INT;
+#endif
+    }
+
+    VICIntEnClr = UART0_INT;
+    if (txIdle) {
+	/* The FIFO is empty and no interrupt is coming, send at once;
+	   the interrupt comes when it is empty again */
+	U0THR = c;
+	txIdle = 0;
+    }
+    else {
+	txBuf[txHead] = c;
+	txHead = next;
+    }
+    VICIntEnable = UART0_INT;
 }
 
 //
@@ -8,11 +8,32 @@
 #define CLOCKS_PCLK 6000000
 #define UART0_BAUD_RATE 19200
 
+/* Transmit ring, emptied into the 16-byte FIFO by the THRE interrupt so
+   that sending only queues the bytes. Size is a power of 2. */
+#ifndef UART0_TX_BUF
+#define UART0_TX_BUF 256
+#endif
+
+/* Full ring: 1 drops the bytes (counted by uart0TxDropped()), 0 waits
+   for room, feeding the FIFO itself while the interrupts are off. */
+#ifndef UART0_TX_DROP
+#define UART0_TX_DROP 0
+#endif
+
+/* VIC vector slot of the UART0 interrupt. */
+#ifndef UART0_VIC_SLOT
+#define UART0_VIC_SLOT 0
+#endif
+
 ///extern const devop_tab_t devop_tab_uart0;
 
 void uart0Init(void);
+void uart0SetBaud(uint32_t baud);
 
 void uart0SendByte(uint8_t c);
+uint32_t uart0IsTxBufferEmpty(void);
+void uart0Flush(void);
+uint32_t uart0TxDropped(void);
 
 int uart0GetByte(void);
 int uart0GetByteWait(void);
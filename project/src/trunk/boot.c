@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include "debug.h"
+#include "trace.h"
+#include "boot.h"
+
+#define BOOT_MARKED     1
+#define BOOT_REPORTED   2
+
+static const char *const bootNames[BOOT_STAGES] = {
+    "clock", "lcd", "eth", "card", "mount", "loop", "ip", "served"
+};
+
+static uint64_t bootTime[BOOT_STAGES];
+static volatile BYTE bootState[BOOT_STAGES];
+
+void bootMark(int stage)
+{
+    if (bootState[stage])
+	return;
+    bootTime[stage] = trace_clock64();
+    bootState[stage] = BOOT_MARKED;
+}
+
+void bootReport(void)
+{
+    uint64_t t;
+    int i;
+
+    for (i = 0; i < BOOT_STAGES; i++) {
+	if (bootState[i] != BOOT_MARKED)
+	    continue;
+	bootState[i] = BOOT_REPORTED;
+	/* In tenths of a millisecond. */
+	t = (bootTime[i] - bootTime[BOOT_CLOCK]) / (trace_clock_hz / 10000);
+	pmesg(MSG_INFO, "boot %-6s %5lu.%lu ms\n", bootNames[i],
+		(unsigned long)(t / 10), (unsigned long)(t % 10));
+    }
+}
@@ -6,7 +6,7 @@
 
 #else
 
-void pmesg(int level, char* format, ...) {
+void pmesg_print(int level, char* format, ...) {
 #ifdef NDEBUG
     /* Empty body, so a good compiler will optimise calls
        to pmesg away */
@@ -8,28 +8,290 @@
 
 #include <stdio.h> 
 #include <stdlib.h>
+#include <string.h>
 #include "disk.h"
 #include "mmc.h"
 #include "spi1.h"
 #include "debug.h"
+#include "trace.h"
+#include "timer.h"
 
 #define S_MAX_SIZ 512
+#define INIT_TIMEOUT      CLOCK_MS(1000)  /* Card idle state, SD spec maximum */
 static volatile DSTATUS gDiskStatus = DSTATUS_NOINIT; 
 static mediaStatus_t mediaStatus;
 
 extern BYTE MMCWRData[MMC_DATA_SIZE];
 extern BYTE MMCRDData[MMC_DATA_SIZE];
+extern DWORD MMCWait;
+
+#if DISK_RA_SECTORS
+static BYTE raData [DISK_RA_SECTORS][S_MAX_SIZ];
+static DWORD raSector [DISK_RA_SECTORS];  /* Sector held by each slot, 0: empty */
+static BYTE raNext;                       /* Slot to be filled next */
+#endif
+static diskRaStats_t raStats;
+
+#define DISK_BAD_SLOTS    4           /* Noted sectors waiting for a spare */
+#define DISK_BAD_SLOW     1           /* Readable, to be copied to a spare */
+#define DISK_BAD_LOST     2           /* Unreadable, redirected at its next write */
+#define DISK_REMAP_MAGIC  0x50414d52  /* "RMAP" */
+
+typedef struct
+{
+  DWORD sector;                       /* Redirected sector */
+  DWORD spare;                        /* Spare sector holding its data */
+}
+remapEntry_t;
+
+static remapEntry_t remap [DISK_REMAP_SLOTS];
+static BYTE remapCount;               /* Entries used in remap[] */
+static DWORD remapTable;              /* Sector of the table, 0: no spare area */
+static WORD remapSpares;              /* Spare sectors after the table */
+static WORD remapNext;                /* Next spare sector to use */
+static DWORD badSector [DISK_BAD_SLOTS];
+static BYTE badState [DISK_BAD_SLOTS];  /* DISK_BAD_xxx, 0: free slot */
+static BYTE lastTries;                /* Retries of the last diskRetry() */
+static diskHealth_t health;
+static DWORD busySector;              /* Sector the card is programming */
+static struct timer initTimer;        /* Deadline of diskInitPoll() */
+static BYTE initStaged;               /* 1: polling, 2: result for diskInitialize() */
+
+#if DISK_ASYNC_WRITE
+#define DISK_WRITE_CMD    mmc_write_start
+#else
+#define DISK_WRITE_CMD    mmc_write_block
+#endif
 
 //
+//  Returns the read-ahead slot holding the sector, or -1
 //
+#if DISK_RA_SECTORS
+static int raFind (DWORD sector)
+{
+  int i;
+
+  if (sector)
+    for (i = 0; i < DISK_RA_SECTORS; i++)
+      if (raSector [i] == sector)
+        return i;
+
+  return -1;
+}
+#endif
+
 //
-DSTATUS diskInitialize (BYTE drv __attribute__ ((unused)))
+//  Returns the sector that holds the data of the sector
+//
+static DWORD remapFind (DWORD sector)
+{
+  int i;
+
+  for (i = 0; i < remapCount; i++)
+    if (remap [i].sector == sector)
+      return remap [i].spare;
+
+  return sector;
+}
+
+//
+//  Runs a block command, repeating it after a growing pause while it fails
+//
+static int diskRetry (int (*cmd) (DWORD), DWORD block)
+{
+  int res;
+
+  for (lastTries = 0; (res = cmd (block)) != 0 && lastTries < DISK_RETRIES; lastTries++)
+  {
+    health.retries++;
+    mmc_idle (DISK_RETRY_CLOCKS << lastTries);
+  }
+  if (res)
+    health.failures++;
+
+  return res;
+}
+
+//
+//  Returns the slot the sector is noted in, or -1
+//
+static int badFind (DWORD sector)
+{
+  int i;
+
+  for (i = 0; i < DISK_BAD_SLOTS; i++)
+    if (badState [i] && badSector [i] == sector)
+      return i;
+
+  return -1;
+}
+
+static void badNote (DWORD sector, BYTE state)
+{
+  int i = badFind (sector);
+
+  if (i < 0)
+    for (i = 0; i < DISK_BAD_SLOTS && badState [i]; i++)
+      ;
+  if (i < DISK_BAD_SLOTS)   /* Otherwise noted again when it is next read */
+  {
+    badSector [i] = sector;
+    badState [i] = state;
+  }
+}
+
+static void badDrop (DWORD sector)
+{
+  int i = badFind (sector);
+
+  if (i >= 0)
+    badState [i] = 0;
+}
+
+//
+//  Waits for the card to program the last sector written, if it still
+//  does. A failure is noted on that sector rather than the next command.
+//
+static int diskSettle (void)
+{
+#if DISK_ASYNC_WRITE
+  if (mmc_write_finish () == 0)
+    return 0;
+
+  health.failures++;
+  badNote (busySector, DISK_BAD_LOST);
+  pmesg (MSG_WARN, "disk: sector %lu not written\n", (unsigned long) busySector);
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+//
+//  Writes the redirection table to the first sector of the spare area
+//
+static int remapSave (void)
+{
+  DWORD head [2];
+
+  head [0] = DISK_REMAP_MAGIC;
+  head [1] = remapCount | ((DWORD) remapNext << 16);
+  memset (MMCWRData, 0, MMC_DATA_SIZE);
+  memcpy (MMCWRData, head, sizeof (head));
+  memcpy (MMCWRData + sizeof (head), remap, remapCount * sizeof (remapEntry_t));
+
+  return diskRetry (mmc_write_block, remapTable);
+}
+
+//
+//  Writes MMCWRData, the data of the sector, to a new spare sector and
+//  redirects the sector there
+//
+static int remapMove (DWORD sector)
+{
+  int i, res = WRITE_BLOCK_FAIL;
+  DWORD spare = 0;
+
+  for (i = 0; i < remapCount && remap [i].sector != sector; i++)
+    ;
+  if (!remapTable || i >= DISK_REMAP_SLOTS)
+    return res;
+
+  while (res && remapNext < remapSpares)  /* A spare failing is used up too */
+  {
+    spare = remapTable + 1 + remapNext++;
+    res = diskRetry (mmc_write_block, spare);
+  }
+  if (res)
+    return res;
+
+  remap [i].sector = sector;
+  remap [i].spare = spare;
+  if (i == remapCount)
+    remapCount++;
+  badDrop (sector);
+  pmesg (MSG_WARN, "disk: sector %lu moved to %lu\n", (unsigned long) sector, (unsigned long) spare);
+
+  if (remapSave ())
+    pmesg (MSG_CRIT, "disk: cannot save the remap table\n");
+  return 0;
+}
+
+static BYTE *readDest;                  /* Buffer of diskReadTo() */
+
+static int diskReadTo (DWORD block)
+{
+  return mmc_read_block_to (block, readDest);
+}
+
+//
+//  Reads the sector into buff, noting it if it is slow or fails
+//
+static int diskCardRead (DWORD sector, BYTE *buff)
+{
+  int slot;
+  int res;
+
+  diskSettle ();
+  slot = badFind (sector);
+
+  if (slot >= 0 && badState [slot] == DISK_BAD_LOST)
+  {
+    /* Known to fail, do not keep the caller waiting on retries */
+    res = mmc_read_block_to (remapFind (sector), buff);
+    if (res == 0)
+      badState [slot] = DISK_BAD_SLOW;
+    return res;
+  }
+
+  readDest = buff;
+  res = diskRetry (diskReadTo, remapFind (sector));
+  if (res)
+    badNote (sector, DISK_BAD_LOST);
+  else if (slot < 0 && (lastTries || MMCWait > DISK_SLOW_WAIT))
+  {
+    health.slow++;
+    badNote (sector, DISK_BAD_SLOW);
+  }
+
+  return res;
+}
+
+//
+//  Writes MMCWRData to the sector, to a spare if it is noted or fails
+//
+static int diskCardWrite (DWORD sector)
+{
+  diskSettle ();
+  if (badFind (sector) >= 0 && remapMove (sector) == 0)
+    return 0;
+  if (diskRetry (DISK_WRITE_CMD, remapFind (sector)) == 0)
+  {
+    busySector = sector;
+    badDrop (sector);
+    return 0;
+  }
+
+  return remapMove (sector);
+}
+
+//
+//  Media Init
+//
+static void diskReset (void)
 {
-  //
-  //  Media Init
-  //
+#if DISK_RA_SECTORS
+  memset(raSector, 0, sizeof(raSector));  /* May be another card */
+#endif
+  remapTable = 0;                         /* ...with its own bad sectors */
+  remapCount = 0;
+  memset(badState, 0, sizeof(badState));
   SPI_Init();
-  switch (mmc_init ())
+}
+
+static DSTATUS diskInitDone (int res)
+{
+  switch (res)
   {
     case 0 :
       {
@@ -53,6 +315,62 @@ DSTATUS diskInitialize (BYTE drv __attribute__ ((unused)))
   return gDiskStatus;
 }
 
+//
+//
+//
+DSTATUS diskInitialize (BYTE drv __attribute__ ((unused)))
+{
+  if (initStaged == 2)
+  {
+    initStaged = 0;                       /* Brought up by diskInitPoll() */
+    return gDiskStatus;
+  }
+  initStaged = 0;
+  diskReset ();
+  return diskInitDone (mmc_init ());
+}
+
+//
+//
+//
+void diskInitStart (void)
+{
+  int res;
+
+  diskReset ();
+  gDiskStatus = DSTATUS_NOINIT;
+  initStaged = 1;
+  timer_set(&initTimer, INIT_TIMEOUT);
+  res = mmc_init_start ();
+  if (res != 0)
+  {
+    diskInitDone (res);
+    initStaged = 2;
+  }
+}
+
+//
+//
+//
+BYTE diskInitPoll (void)
+{
+  int res;
+
+  if (initStaged != 1)
+    return 0;
+
+  res = mmc_init_poll ();
+  if (res == MMC_INIT_BUSY)
+  {
+    if (!timer_expired(&initTimer))
+      return 1;
+    res = OP_COND_TIMEOUT;
+  }
+  diskInitDone (res);
+  initStaged = 2;
+  return 0;
+}
+
 //
 //
 //
@@ -77,31 +395,46 @@ DSTATUS diskStatus (BYTE drv __attribute__ ((unused)))
 //
 DRESULT diskRead (BYTE disk __attribute__ ((unused)), BYTE *buff, DWORD sector, BYTE count)
 {
-  DWORD res = 0;
+  int res = 0;
   int i;
 
   if (gDiskStatus & DSTATUS_NOINIT) 
     return DRESULT_NOTRDY;
   if (!count) 
     return DRESULT_PARERR;
-  pmesg(MSG_DEBUG_MORE,"diskRead ( %d , %d )\n", sector, count);
+  pmesg(MSG_DEBUG_MORE,"diskRead ( %lu , %d )\n", (unsigned long) sector, count);
+  TRACE_EV(TEV_DISK_READ, count, sector);
   for (i = 0; i < count; i++)
   {
-		res = mmc_read_block(i + sector);
+		raStats.reads++;
+#if DISK_RA_SECTORS
+		int slot = raFind(i + sector);
+		if (slot >= 0)
+		{
+			/* Read ahead earlier, each slot is used once. */
+			memcpy(buff + i*512, raData [slot], 512);
+			raSector [slot] = 0;
+			raStats.hits++;
+			continue;
+		}
+#endif
+		/* Straight into the caller's buffer, no copy */
+		res = diskCardRead(i + sector, buff + i*512);
+#if PMESG_ON(MSG_DEBUG_MORE)
 int j;
 for (j = 0 ; j < 512; j++)
 {
-	pmesg(MSG_DEBUG_MORE,"%x ", MMCRDData[j]);
+	pmesg(MSG_DEBUG_MORE,"%x ", buff[i*512 + j]);
 	if (((j+1) % 32) == 0) pmesg(MSG_DEBUG_MORE,"\n");
 }
+#endif
 
-		if (res == 0)
-			memcpy(buff + i*512, MMCRDData, 512);
-		else
+		if (res != 0)
 			break;
   }
   
 pmesg(MSG_DEBUG_MORE,"&&&diskread result=%d\n",res);
+  TRACE_EV(TEV_DISK_DONE, res ? DRESULT_ERROR : DRESULT_OK, raStats.hits);
   if (res == 0)
     return DRESULT_OK;
   else
@@ -114,15 +447,17 @@ pmesg(MSG_DEBUG_MORE,"&&&diskread result=%d\n",res);
 #if _FS_READONLY == 0
 DRESULT diskWrite (BYTE disk __attribute__ ((unused)), const BYTE *buff, DWORD sector, BYTE count)
 {
-  DWORD res = 0;
+  int res = 0;
   int i;
 
+#if PMESG_ON(MSG_DEBUG_MORE)
 int j;
 for (j = 0; j < 512; j++)
 {
 	pmesg(MSG_DEBUG_MORE,"%x ", MMCWRData[j]);
 	if (((j+1) % 32) == 0) pmesg(MSG_DEBUG_MORE,"\n");
 }
+#endif
 
 
   if (gDiskStatus & DSTATUS_NOINIT) 
@@ -139,8 +474,13 @@ for (j = 0; j < 512; j++)
 			memcpy(MMCWRData, buff + i*512, 512);
 		else
 			break;
+#if DISK_RA_SECTORS
+		int slot = raFind(i + sector);
+		if (slot >= 0)
+			raSector [slot] = 0;	/* Drop the stale copy */
+#endif
 
-		res = mmc_write_block(i+sector);
+		res = diskCardWrite(i+sector);
   }
 
 pmesg(MSG_DEBUG_MORE,"&&&diskwrite result=%d\n",res);
@@ -157,9 +497,6 @@ pmesg(MSG_DEBUG_MORE,"&&&diskwrite result=%d\n",res);
 DRESULT diskIoctl (BYTE drv, BYTE ctrl, void *buff)
 {
   DRESULT res;
-  BYTE n;
-  BYTE csd [16];
-  short csize;
 
   if (drv) 
     return DRESULT_PARERR;
@@ -174,8 +511,9 @@ DRESULT diskIoctl (BYTE drv, BYTE ctrl, void *buff)
   {
     case IOCTL_GET_SECTOR_COUNT :
       { 
-         pmesg(MSG_DEBUG_MORE,"\n IOCTL QRY CAP %d \n", mmc_card_capacity() / 512);
-		return mmc_card_capacity() / 512;
+         pmesg(MSG_DEBUG_MORE,"\n IOCTL QRY CAP %lu \n", (unsigned long) (mmc_card_capacity() / 512));
+		res = DRESULT_OK;
+		(*(DWORD*)buff) = mmc_card_capacity() / 512;
       }
       break;
 
@@ -188,7 +526,7 @@ DRESULT diskIoctl (BYTE drv, BYTE ctrl, void *buff)
 
     case IOCTL_CTRL_SYNC :
       {
-	    res = DRESULT_OK;
+	    res = diskSettle () ? DRESULT_ERROR : DRESULT_OK;
       }
       break;
 
@@ -219,7 +557,141 @@ DRESULT diskIoctl (BYTE drv, BYTE ctrl, void *buff)
 
   pmesg(MSG_DEBUG_MORE,"&&&diskioctl result=%d\n",res);
 
-  return 0;
+  return res;
+}
+
+//
+//  Reads up to count sectors from sector on into the read-ahead cache,
+//  skipping the ones already there. Never takes more than the cache holds.
+//
+DRESULT diskPrefetch (BYTE drv __attribute__ ((unused)), DWORD sector, BYTE count)
+{
+#if DISK_RA_SECTORS
+  if (gDiskStatus & DSTATUS_NOINIT) 
+    return DRESULT_NOTRDY;
+  if (count > DISK_RA_SECTORS) 
+    count = DISK_RA_SECTORS;
+
+  for ( ; count; count--, sector++)
+  {
+    if (raFind(sector) >= 0)
+      continue;
+    raSector [raNext] = 0;      /* A failed read leaves the slot empty */
+    if (diskCardRead(sector, raData [raNext]) != 0)
+      return DRESULT_ERROR;
+    raSector [raNext] = sector;
+    if (++raNext >= DISK_RA_SECTORS)
+      raNext = 0;
+    raStats.prefetched++;
+  }
+#endif
+  return DRESULT_OK;
+}
+
+//
+//
+//
+const diskRaStats_t *diskReadAheadStats (void)
+{
+  return &raStats;
+}
+
+//
+//  Sets the spare area: the table sector, then count - 1 spare sectors.
+//  A fresh area starts with an empty table, otherwise the table is read.
+//
+DRESULT diskRemapInit (BYTE drv __attribute__ ((unused)), DWORD sector, WORD count, BYTE fresh)
+{
+  DWORD head [2];
+  WORD n;
+
+  if (gDiskStatus & DSTATUS_NOINIT) 
+    return DRESULT_NOTRDY;
+  if (count < 2) 
+    return DRESULT_PARERR;
+
+  remapTable = 0;             /* No redirection while the table is read */
+  remapCount = 0;
+  remapNext = 0;
+  remapSpares = count - 1;
+  diskSettle ();
+  if (!fresh)
+  {
+    if (diskRetry (mmc_read_block, sector))
+      return DRESULT_ERROR;
+    memcpy (head, MMCRDData, sizeof (head));
+    n = head [1] & 0xFFFF;
+    if (head [0] == DISK_REMAP_MAGIC && n <= DISK_REMAP_SLOTS && (head [1] >> 16) <= remapSpares)
+    {
+      memcpy (remap, MMCRDData + sizeof (head), n * sizeof (remapEntry_t));
+      remapCount = n;
+      remapNext = head [1] >> 16;
+    }
+    else
+      fresh = 1;
+  }
+
+  remapTable = sector;
+  if (fresh && remapSave ())
+  {
+    remapTable = 0;
+    return DRESULT_ERROR;
+  }
+  pmesg (MSG_DEBUG, "disk: %d sectors remapped, %d spares left\n", remapCount, remapSpares - remapNext);
+
+  return DRESULT_OK;
+}
+
+//
+//  Background card scan, one sector per call. A sector noted as slow is
+//  copied to a spare first, otherwise the next of the first count sectors
+//  of the card is read and noted if it is slow or fails.
+//
+DRESULT diskScan (BYTE drv __attribute__ ((unused)), DWORD count)
+{
+  DWORD sector;
+  int i;
+
+  if (gDiskStatus & DSTATUS_NOINIT) 
+    return DRESULT_NOTRDY;
+
+  for (i = 0; i < DISK_BAD_SLOTS && badState [i] != DISK_BAD_SLOW; i++)
+    ;
+  if (i < DISK_BAD_SLOTS && remapTable && remapNext < remapSpares)
+  {
+    sector = badSector [i];
+    if (diskCardRead (sector, MMCRDData) != 0)
+      return DRESULT_ERROR;     /* Noted as unreadable now */
+    memcpy (MMCWRData, MMCRDData, MMC_DATA_SIZE);
+    if (remapMove (sector) == 0)
+      return DRESULT_OK;
+    badState [i] = 0;           /* No room in the table, let it be */
+    return DRESULT_ERROR;
+  }
+
+  if (health.scanPos >= count)
+    health.scanPos = 0;
+  sector = health.scanPos++;
+  health.scanned++;
+
+  return diskCardRead (sector, MMCRDData) ? DRESULT_ERROR : DRESULT_OK;
+}
+
+//
+//
+//
+const diskHealth_t *diskHealthStats (void)
+{
+  int i;
+
+  health.remapped = remapCount;
+  health.sparesLeft = remapTable ? remapSpares - remapNext : 0;
+  health.pending = 0;
+  for (i = 0; i < DISK_BAD_SLOTS; i++)
+    if (badState [i])
+      health.pending++;
+
+  return &health;
 }
 
 //
@@ -79,10 +79,86 @@ typedef struct
 } 
 mediaStatus_t;
 
+//
+//  Read-ahead cache. Sectors fetched with diskPrefetch() while the caller
+//  has nothing better to do are kept in DISK_RA_SECTORS slots of RAM (512
+//  bytes each) and handed out once by diskRead(). 0 disables the cache.
+//
+#ifndef DISK_RA_SECTORS
+#define DISK_RA_SECTORS 4
+#endif
+
+typedef struct
+{
+  DWORD reads;        /* Sectors asked for by diskRead */
+  DWORD hits;         /* ...of which came from the read-ahead cache */
+  DWORD prefetched;   /* Sectors read ahead by diskPrefetch */
+}
+diskRaStats_t;
+
+//
+//  Bad sectors. A failed card command is repeated up to DISK_RETRIES times,
+//  each time after twice as many idle clocks (DISK_RETRY_CLOCKS bytes the
+//  first time). Sectors that fail or answer slower than DISK_SLOW_WAIT
+//  bytes are noted, and diskScan() reads the whole card in the background
+//  to find them before a client does. Once a spare area is given with
+//  diskRemapInit(), a noted sector is copied to a spare sector and
+//  redirected there; one that could not be read at all is redirected at
+//  its next write. The table of up to DISK_REMAP_SLOTS redirections is
+//  kept in the first sector of the spare area.
+//
+#ifndef DISK_RETRIES
+#define DISK_RETRIES 3
+#endif
+#ifndef DISK_RETRY_CLOCKS
+#define DISK_RETRY_CLOCKS 64
+#endif
+#ifndef DISK_SLOW_WAIT
+#define DISK_SLOW_WAIT 1024
+#endif
+#ifndef DISK_REMAP_SLOTS
+#define DISK_REMAP_SLOTS 16
+#endif
+
+//
+//  Asynchronous writes. diskWrite() returns once the card has taken the
+//  data and leaves it programming the sector, the next card command (or
+//  IOCTL_CTRL_SYNC, which f_sync() issues) waits for it. A write that
+//  then turns out to have failed is noted like an unreadable sector.
+//  0 waits for every sector to be programmed.
+//
+#ifndef DISK_ASYNC_WRITE
+#define DISK_ASYNC_WRITE 1
+#endif
+
+//
+//  Staged bring-up. diskInitStart() resets the card, then diskInitPoll()
+//  asks it once per call whether it left its idle state, returning 1 as
+//  long as it did not (for up to a second), so the boot can get on with
+//  other devices meanwhile. diskStatus() then tells how it went. The
+//  first diskInitialize(), from the mount, takes that result instead of
+//  resetting the card again.
+//
+
+typedef struct
+{
+  DWORD retries;      /* Card commands repeated after a failure */
+  DWORD failures;     /* ...that failed on every try */
+  DWORD slow;         /* Slow sectors found */
+  DWORD scanned;      /* Sectors read by diskScan */
+  DWORD scanPos;      /* Next sector diskScan reads */
+  BYTE remapped;      /* Sectors redirected to a spare */
+  BYTE sparesLeft;    /* Spare sectors not used yet */
+  BYTE pending;       /* Noted sectors waiting to be redirected */
+}
+diskHealth_t;
+
 //
 //
 //
 DSTATUS diskInitialize (BYTE);
+void diskInitStart (void);
+BYTE diskInitPoll (void);
 DSTATUS diskShutdown (void);
 DSTATUS diskStatus (BYTE);
 DRESULT diskRead (BYTE, BYTE *, DWORD, BYTE);
@@ -90,6 +166,11 @@ DRESULT diskRead (BYTE, BYTE *, DWORD, BYTE);
 DRESULT diskWrite (BYTE, const BYTE *, DWORD, BYTE);
 #endif
 DRESULT diskIoctl (BYTE, BYTE, void *);
+DRESULT diskPrefetch (BYTE, DWORD, BYTE);
+const diskRaStats_t *diskReadAheadStats (void);
+DRESULT diskRemapInit (BYTE, DWORD, WORD, BYTE);
+DRESULT diskScan (BYTE, DWORD);
+const diskHealth_t *diskHealthStats (void);
 BYTE diskPresent (void);
 const char *diskErrorText (DRESULT d);
 void diskErrorTextPrint (DRESULT d);
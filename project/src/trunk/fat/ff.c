@@ -59,6 +59,66 @@
 static FATFS *FatFs [_DRIVES]; /* Pointer to the file system objects (logical drives) */
 static WORD fsid;        /* File system mount ID */
 
+#if _FS_STATS
+FFSTATS ff_stats;         /* Access counters */
+#define FF_COUNT(c) (ff_stats.c++)
+#else
+#define FF_COUNT(c)
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write pending FAT mirror copies                                       */
+/*-----------------------------------------------------------------------*/
+
+#if _FS_READONLY == 0 && _FS_MIRROR_DEFER
+static
+BOOL flush_mirror (   /* TRUE: successful, FALSE: failed */
+    FATFS *fs     /* File system object, the window must be clean */
+    )
+{
+  DWORD sect;
+  BYTE i, n;
+
+
+  for (i = 0; i < fs->n_mirror; i++) {
+    sect = fs->mirror[i];
+    if (sect != fs->winsect) {  /* Borrow the window to copy the primary FAT sector */
+      fs->winsect = 0;          /* The read goes straight into the window */
+      if (diskRead(fs->drive, fs->win, sect, 1) != DRESULT_OK)
+        return FALSE;
+      fs->winsect = sect;
+    }
+    for (n = fs->n_fats; n >= 2; n--) { /* Refrect it to the FAT copies */
+      sect += fs->sects_fat;
+      diskWrite(fs->drive, fs->win, sect, 1);
+    }
+  }
+  fs->n_mirror = 0;
+  return TRUE;
+}
+
+
+static
+BOOL defer_mirror (   /* TRUE: successful, FALSE: failed */
+    FATFS *fs,    /* File system object, the window must be clean */
+    DWORD sect    /* Primary FAT sector that has just been written */
+    )
+{
+  BYTE i;
+
+
+  for (i = 0; i < fs->n_mirror; i++)
+    if (fs->mirror[i] == sect) return TRUE; /* Already pending */
+  if (fs->n_mirror >= _FS_MIRROR_DEFER && !flush_mirror(fs))
+    return FALSE;
+  fs->mirror[fs->n_mirror++] = sect;
+  return TRUE;
+}
+#endif
+
+
 
 
 /*-----------------------------------------------------------------------*/
@@ -77,22 +137,32 @@ BOOL move_window (    /* TRUE: successful, FALSE: failed */
   wsect = fs->winsect;
   if (wsect != sector) {  /* Changed current window */
 #if _FS_READONLY == 0
+#if !_FS_MIRROR_DEFER
     BYTE n;
+#endif
     if (fs->winflag) {  /* Write back dirty window if needed */
       if (diskWrite(fs->drive, fs->win, wsect, 1) != DRESULT_OK)
         return FALSE;
+      FF_COUNT(win_writes);
       fs->winflag = 0;
-      if (wsect < (fs->fatbase + fs->sects_fat)) {  /* In FAT area */
+      if (wsect >= fs->fatbase && wsect < (fs->fatbase + fs->sects_fat)) {  /* In FAT area */
+#if _FS_MIRROR_DEFER
+        if (fs->n_fats >= 2 && !defer_mirror(fs, wsect))  /* Copies are written later */
+          return FALSE;
+#else
         for (n = fs->n_fats; n >= 2; n--) { /* Refrect the change to FAT copy */
           wsect += fs->sects_fat;
           diskWrite(fs->drive, fs->win, wsect, 1);
         }
+#endif
       }
     }
 #endif
     if (sector) {
+      fs->winsect = 0;    /* A failed read leaves no valid window */
       if (diskRead(fs->drive, fs->win, sector, 1) != DRESULT_OK)
         return FALSE;
+      FF_COUNT(win_reads);
       fs->winsect = sector;
     }
   }
@@ -102,6 +172,33 @@ BOOL move_window (    /* TRUE: successful, FALSE: failed */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Set or clear the clean shutdown flag of a FAT32 volume                */
+/*-----------------------------------------------------------------------*/
+
+#if _FS_READONLY == 0 && _USE_FSINFO
+static
+BOOL set_volclean (   /* TRUE: successful, FALSE: failed */
+    FATFS *fs,      /* File system object */
+    BYTE clean      /* 1: FAT and fsinfo agree, 0: the FAT is being changed */
+    )
+{
+  BYTE *p;
+
+
+  if (!move_window(fs, fs->fatbase)) return FALSE;
+  p = &fs->win[4 + 3];  /* Bit 27 of FAT[1] */
+  *p = clean ? (*p | 0x08) : (*p & ~0x08);
+  fs->winflag = 1;
+  if (!move_window(fs, 0)) return FALSE;  /* Must reach the disk ahead of the FAT change */
+  fs->vol_clean = clean;
+  return TRUE;
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Clean-up cached data                                                  */
 /*-----------------------------------------------------------------------*/
@@ -114,17 +211,28 @@ FRESULT sync (      /* FR_OK: successful, FR_RW_ERROR: failed */
 {
   fs->winflag = 1;
   if (!move_window(fs, 0)) return FR_RW_ERROR;
-#if 0//_USE_FSINFO
-  if (fs->fs_type == FS_FAT32 && fs->fsi_flag) {    /* Update FSInfo sector if needed */
-    fs->winsect = 0;
-    memset(fs->win, 0, 512);
-    ST_WORD(&fs->win[BS_55AA], 0xAA55);
-    ST_DWORD(&fs->win[FSI_LeadSig], 0x41615252);
-    ST_DWORD(&fs->win[FSI_StrucSig], 0x61417272);
+#if _FS_MIRROR_DEFER
+  if (!flush_mirror(fs)) return FR_RW_ERROR; /* FAT copies are complete before fsinfo */
+#endif
+#if _USE_FSINFO
+  if (fs->fs_type == FS_FAT32 && (fs->fsi_flag || !fs->vol_clean)) {  /* Update FSInfo sector if needed */
+    if (!move_window(fs, fs->fsi_sector)) return FR_RW_ERROR;
+    if (LD_WORD(&fs->win[BS_55AA]) != 0xAA55 ||
+        LD_DWORD(&fs->win[FSI_LeadSig]) != 0x41615252 ||
+        LD_DWORD(&fs->win[FSI_StrucSig]) != 0x61417272) {
+      memset(fs->win, 0, 512);
+      ST_WORD(&fs->win[BS_55AA], 0xAA55);
+      ST_DWORD(&fs->win[FSI_LeadSig], 0x41615252);
+      ST_DWORD(&fs->win[FSI_StrucSig], 0x61417272);
+    }
     ST_DWORD(&fs->win[FSI_Free_Count], fs->free_clust);
     ST_DWORD(&fs->win[FSI_Nxt_Free], fs->last_clust);
-    diskWrite(0, fs->win, fs->fsi_sector, 1);
+    fs->winflag = 1;
     fs->fsi_flag = 0;
+    if (!set_volclean(fs, 1)) return FR_RW_ERROR;  /* Flushes the fsinfo sector first */
+#if _FS_MIRROR_DEFER
+    if (!flush_mirror(fs)) return FR_RW_ERROR;
+#endif
   }
 #endif
   if (diskIoctl(fs->drive, IOCTL_CTRL_SYNC, NULL) != DRESULT_OK) return FR_RW_ERROR;
@@ -150,6 +258,7 @@ DWORD get_cluster (   /* 0,>=2: successful, 1: failed */
 
 
   if (clust >= 2 && clust < fs->max_clust) {    /* Valid cluster# */
+    FF_COUNT(fat_gets);
     fatsect = fs->fatbase;
     switch (fs->fs_type) {
       case FS_FAT12 :
@@ -176,6 +285,101 @@ DWORD get_cluster (   /* 0,>=2: successful, 1: failed */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Free cluster map                                                      */
+/*-----------------------------------------------------------------------*/
+
+#if _FS_READONLY == 0 && _USE_FREEMAP
+#define FMAP_EPC(fs) ((fs)->fs_type == FS_FAT16 ? S_SIZ / 2 : S_SIZ / 4) /* FAT entries per sector */
+#define FMAP_EPG(fs) ((DWORD)FMAP_EPC(fs) << (fs)->fmap_shift)        /* Clusters per map group */
+#define fmap_build(fs) fmap_scan(fs, (fs)->sects_fat)                 /* Complete the scan now */
+
+static
+BOOL fmap_scan (    /* TRUE: successful (fmap_valid tells if the map is usable), FALSE: disk error */
+    FATFS *fs,    /* File system object */
+    DWORD nsect   /* Number of FAT sectors to scan at most */
+    )
+{
+  DWORD clust, val;
+  WORD f, epc;
+  BYTE *p;
+
+
+  if (fs->fmap_valid == 1 || fs->fmap_valid == 2) return TRUE;
+  if (!fs->fmap_valid) {      /* Start a new scan */
+    fs->fmap_valid = 2;
+    if (fs->fs_type == FS_FAT12) return TRUE; /* The whole FAT is a few sectors anyway */
+    fs->fmap_shift = 0;
+    while (((fs->sects_fat - 1) >> fs->fmap_shift) >= _USE_FREEMAP) fs->fmap_shift++;
+    if (FMAP_EPG(fs) > 0xFFFF) return TRUE;  /* Group counts would not fit */
+    memset(fs->fmap, 0, sizeof(fs->fmap));
+    fs->fmap_next = 0;
+    fs->fmap_valid = 3;
+  }
+
+  epc = FMAP_EPC(fs);
+  clust = fs->fmap_next * epc;
+  for ( ; nsect && clust < fs->max_clust; nsect--) {
+    if (!move_window(fs, fs->fatbase + fs->fmap_next)) return FALSE;
+    p = fs->win;
+    for (f = 0; f < epc && clust < fs->max_clust; f++, clust++) {
+      if (fs->fs_type == FS_FAT16) {
+        val = LD_WORD(p); p += 2;
+      } else {
+        val = LD_DWORD(p) & 0x0FFFFFFF; p += 4;
+      }
+      if (val == 0 && clust >= 2)
+        fs->fmap[fs->fmap_next >> fs->fmap_shift]++;
+    }
+    fs->fmap_next++;
+  }
+
+  if (clust >= fs->max_clust) {   /* Scan completed, the exact count comes for free */
+    for (val = 0, f = 0; f < _USE_FREEMAP; f++) val += fs->fmap[f];
+    fs->free_clust = val;
+#if _USE_FSINFO
+    if (fs->fs_type == FS_FAT32) fs->fsi_flag = 1;
+#endif
+    fs->fmap_valid = 1;
+  }
+  return TRUE;
+}
+
+
+static
+DWORD fmap_find (   /* 0: no free cluster, 1: error, >=2: free cluster# */
+    FATFS *fs,    /* File system object */
+    DWORD clust   /* Cluster# to start the search at */
+    )
+{
+  DWORD cstat, end, epg = FMAP_EPG(fs);
+  WORD g, ng, n;
+
+
+  ng = (WORD)((fs->max_clust + epg - 1) / epg);   /* Number of groups in use */
+  if (clust < 2 || clust >= fs->max_clust) clust = 2;
+  g = (WORD)(clust / epg);
+  for (n = 0; n <= ng; n++) {   /* The first group is visited twice if the search wraps */
+    if (fs->fmap[g]) {      /* Only groups known to have a free cluster are read */
+      end = (g + 1) * epg;
+      if (end > fs->max_clust) end = fs->max_clust;
+      for ( ; clust < end; clust++) {
+        cstat = get_cluster(fs, clust);
+        if (cstat == 0) return clust;
+        if (cstat == 1) return 1;
+      }
+    }
+    if (++g >= ng) g = 0;
+    clust = g * epg;
+    if (clust < 2) clust = 2;
+  }
+  return 0;
+}
+#endif /* _USE_FREEMAP */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Change a cluster status                                               */
 /*-----------------------------------------------------------------------*/
@@ -191,8 +395,15 @@ BOOL put_cluster (    /* TRUE: successful, FALSE: failed */
   WORD bc;
   BYTE *p;
   DWORD fatsect;
+#if _USE_FREEMAP
+  DWORD old = 0;
+#endif
 
 
+#if _USE_FSINFO
+  if (fs->vol_clean && !set_volclean(fs, 0)) return FALSE;  /* fsinfo goes stale from here */
+#endif
+  FF_COUNT(fat_puts);
   fatsect = fs->fatbase;
   switch (fs->fs_type) {
     case FS_FAT12 :
@@ -209,18 +420,33 @@ BOOL put_cluster (    /* TRUE: successful, FALSE: failed */
 
     case FS_FAT16 :
       if (!move_window(fs, fatsect + (clust / (S_SIZ / 2)))) return FALSE;
-      ST_WORD(&fs->win[((WORD)clust * 2) & (S_SIZ - 1)], (WORD)val);
+      p = &fs->win[((WORD)clust * 2) & (S_SIZ - 1)];
+#if _USE_FREEMAP
+      old = LD_WORD(p);
+#endif
+      ST_WORD(p, (WORD)val);
       break;
 
     case FS_FAT32 :
       if (!move_window(fs, fatsect + (clust / (S_SIZ / 4)))) return FALSE;
-      ST_DWORD(&fs->win[((WORD)clust * 4) & (S_SIZ - 1)], val);
+      p = &fs->win[((WORD)clust * 4) & (S_SIZ - 1)];
+#if _USE_FREEMAP
+      old = LD_DWORD(p) & 0x0FFFFFFF;
+#endif
+      ST_DWORD(p, val);
       break;
 
     default :
       return FALSE;
   }
   fs->winflag = 1;
+#if _USE_FREEMAP
+  if (!old != !val && (fs->fmap_valid == 1 ||   /* Cluster freed or taken */
+      (fs->fmap_valid == 3 && clust / FMAP_EPC(fs) < fs->fmap_next))) {
+    bc = (WORD)(clust / FMAP_EPG(fs));
+    if (val) fs->fmap[bc]--; else fs->fmap[bc]++;
+  }
+#endif
   return TRUE;
 }
 #endif /* !_FS_READONLY */
@@ -286,6 +512,14 @@ DWORD create_chain (  /* 0: no free cluster, 1: error, >=2: new cluster number *
     scl = clust;
   }
 
+#if _USE_FREEMAP
+  if (!fmap_build(fs)) return 1;
+  if (fs->fmap_valid == 1) {  /* Skip the groups with no free cluster */
+    ncl = fmap_find(fs, scl + 1);
+    if (ncl < 2) return ncl;
+  } else
+#endif
+  {
   ncl = scl;        /* Start cluster */
   for (;;) {
     ncl++;              /* Next cluster */
@@ -298,6 +532,7 @@ DWORD create_chain (  /* 0: no free cluster, 1: error, >=2: new cluster number *
     if (cstat == 1) return 1;   /* Any error occured */
     if (ncl == scl) return 0;   /* No free custer */
   }
+  }
 
   if (!put_cluster(fs, ncl, 0x0FFFFFFF)) return 1;    /* Mark the new cluster "in use" */
   if (clust && !put_cluster(fs, clust, ncl)) return 1;  /* Link it to previous one if needed */
@@ -410,6 +645,9 @@ void get_fileinfo (   /* No return code */
   finfo->fsize = LD_DWORD(&dir[DIR_FileSize]);  /* Size */
   finfo->fdate = LD_WORD(&dir[DIR_WrtDate]);   /* Date */
   finfo->ftime = LD_WORD(&dir[DIR_WrtTime]);   /* Time */
+#if _USE_LFN
+  finfo->lfname = NULL;
+#endif
 }
 #endif /* _FS_MINIMIZE <= 1 */
 
@@ -476,7 +714,666 @@ md_l2:
     if (n >= t) break;
     dirname[n++] = c;
   }
-  return 1;
+  return 1;
+}
+
+
+
+
+#if _USE_LFN
+/*-----------------------------------------------------------------------*/
+/* Long file name                                                        */
+/*-----------------------------------------------------------------------*/
+
+typedef struct _LFNCTX
+{
+  const char *name; /* Name to compare with the long names read (NULL: none) */
+  WORD nlen;        /* Length of the name */
+  WORD len;         /* Length of the long name read */
+  DWORD hash;       /* Hash of the long name read (of the name until one is read) */
+  DWORD clust;      /* Location of the first LFN entry of the long name */
+  DWORD sect;
+  WORD index;
+  BYTE ord;         /* Number of the next LFN entry expected, 0: complete, 0xFF: none */
+  BYTE n;           /* Number of LFN entries of the long name */
+  BYTE sum;         /* Checksum of the 8.3 name they belong to */
+  BYTE match;       /* The characters read so far matched the name */
+}
+LFNCTX;
+
+static const BYTE lfn_ofs[13] = {1,3,5,7,9,14,16,18,20,22,24,28,30};  /* Characters in an LFN entry */
+static char lfn_buf[_LFN_BUF];  /* Long name read last */
+static LFNCTX lfn_cur;          /* Long name of the path segment traced last */
+
+/* A name hashes to the sum of its characters hashed with their positions,
+   so the parts of a long name can be hashed in the reversed disk order. */
+#define LFN_HASH(c,pos) (((DWORD)(c) | ((DWORD)(pos) << 8)) * 2654435761UL)
+
+
+static
+BYTE lfn_fold (   /* Upper case Latin-1 character, 0: not Latin-1 */
+    WORD c
+    )
+{
+  if (c >= 0x100) return 0;
+  if ((c >= 'a' && c <= 'z') || (c >= 0xE0 && c <= 0xFE && c != 0xF7)) c -= 0x20;
+  return (BYTE)c;
+}
+
+
+static
+void lfn_init (   /* No return code */
+    LFNCTX *lc,     /* Long name context to initialize */
+    const char *name, /* Name to look for, NULL to read long names only */
+    WORD nlen     /* Length of the name */
+    )
+{
+  WORD i;
+
+
+  lc->name = name;
+  lc->nlen = nlen;
+  lc->hash = LFN_HASH(0, nlen);
+  for (i = 0; i < nlen; i++)
+    lc->hash += LFN_HASH(lfn_fold((BYTE)name[i]), i);
+  lc->ord = 0xFF;
+  lc->n = 0;
+}
+
+
+static
+void lfn_key (    /* No return code */
+    char *fn,       /* Key to return in the place of the 8.3 name {0, hash(4), length, name(5), 0} */
+    const LFNCTX *lc  /* Long name context with the name */
+    )
+{
+  BYTE n;
+
+
+  /* No 8.3 entry starts with a zero, the key finds the dcache slot only */
+  fn[0] = 0;
+  ST_DWORD(&fn[1], lc->hash);
+  fn[5] = (char)lc->nlen;
+  for (n = 0; n < 5; n++)
+    fn[6 + n] = (n < lc->nlen) ? lfn_fold((BYTE)lc->name[n]) : 0;
+  fn[11] = 0;
+}
+
+
+static
+BYTE lfn_sum (    /* Checksum of an 8.3 name */
+    const BYTE *dptr  /* Pointer to the entry */
+    )
+{
+  BYTE n, sum = 0;
+
+
+  for (n = 0; n < 8+3; n++)
+    sum = ((sum & 1) ? 0x80 : 0) + (sum >> 1) + dptr[DIR_Name + n];
+  return sum;
+}
+
+
+static
+BYTE lfn_feed (   /* 1: an 8.3 entry with a long name, 0: otherwise */
+    LFNCTX *lc,     /* Long name context */
+    const DIR *dirobj,  /* Directory object pointing the entry */
+    const BYTE *dptr  /* Pointer to the entry in the window */
+    )
+{
+  BYTE ord, i, c;
+  WORD w, pos;
+
+
+  if (dptr[DIR_Name] != 0xE5 && (dptr[DIR_Attr] & 0x3F) == AM_LFN) {
+    ord = dptr[LDIR_Ord];
+    if (ord & 0x40) {       /* The last part of the name comes first */
+      ord &= 0x3F;
+      lc->ord = lc->n = ord;
+      lc->sum = dptr[LDIR_Chksum];
+      lc->clust = dirobj->clust;
+      lc->sect = dirobj->sect;
+      lc->index = dirobj->index;
+      lc->hash = 0;
+      lc->match = 1;
+    }
+    if (ord == 0 || ord > 20 || ord != lc->ord || dptr[LDIR_Chksum] != lc->sum) {
+      lc->ord = 0xFF; return 0;   /* Broken sequence */
+    }
+    pos = (ord - 1) * 13;
+    for (i = 0; i < 13; i++) {    /* Compare and keep the characters as they come */
+      w = LD_WORD(&dptr[lfn_ofs[i]]);
+      if (w == 0) break;
+      c = lfn_fold(w);
+      lc->hash += LFN_HASH(c, pos);
+      if (lc->name && (pos >= lc->nlen || !c || lfn_fold((BYTE)lc->name[pos]) != c))
+        lc->match = 0;
+      if (pos < _LFN_BUF - 1) lfn_buf[pos] = (w < 0x100) ? (char)w : '?';
+      pos++;
+    }
+    if (ord == lc->n) {       /* The name ends in this part */
+      lc->len = pos;
+      lc->hash += LFN_HASH(0, pos);
+      if (lc->name && pos != lc->nlen) lc->match = 0;
+      if (pos < _LFN_BUF) lfn_buf[pos] = '\0';
+    }
+    lc->ord = ord - 1;
+    return 0;
+  }
+
+  i = (lc->ord == 0 && dptr[DIR_Name] != 0xE5 && !(dptr[DIR_Attr] & AM_VOL)
+       && lfn_sum(dptr) == lc->sum);
+  lc->ord = 0xFF;
+  return i;
+}
+
+
+#if !_FS_READONLY
+static
+BOOL lfn_remove (   /* TRUE: successful, FALSE: failed */
+    FATFS *fs,      /* File system object */
+    const LFNCTX *lc  /* Long name found with the entry to be removed */
+    )
+{
+  DIR dirobj;
+  BYTE n;
+
+
+  dirobj.fs = fs;
+  dirobj.clust = lc->clust;
+  dirobj.sect = lc->sect;
+  dirobj.index = lc->index;
+  for (n = 0; n < lc->n; n++) {
+    if (!move_window(fs, dirobj.sect)) return FALSE;
+    fs->win[(dirobj.index & ((S_SIZ - 1) / 32)) * 32] = 0xE5;
+    fs->winflag = 1;
+    if (!next_dir_entry(&dirobj)) break;
+  }
+  return TRUE;
+}
+#endif
+#endif /* _USE_LFN */
+
+
+
+
+#if _USE_DCACHE
+/*-----------------------------------------------------------------------*/
+/* Directory entry cache                                                 */
+/*-----------------------------------------------------------------------*/
+
+typedef struct _DCENT
+{
+  WORD id;        /* Mount ID of the owner file system (0: unused slot) */
+  WORD index;     /* Index of the entry in the parent directory */
+  DWORD pclust;   /* Start cluster of the parent directory (0: static root) */
+  DWORD clust;    /* Cluster containing the entry */
+  DWORD sect;     /* Sector containing the entry */
+  DWORD fclust;   /* Start cluster of the object */
+  char name[8+3]; /* Name in directory entry format (or key of a long name) */
+  BYTE attr;      /* Attribute of the object */
+#if _USE_LFN
+  BYTE back;      /* Number of LFN entries before the entry (key of a long name) */
+#endif
+}
+DCENT;
+
+static DCENT dcache [_USE_DCACHE];  /* Directory entry cache slots */
+static BYTE dcache_next;            /* Next slot to be replaced */
+
+
+static
+DCENT *dcache_find (  /* Pointer to the matched slot, NULL: not cached */
+    const FATFS *fs,  /* File system object */
+    DWORD pclust,     /* Start cluster of the parent directory */
+    const char *fn    /* Name in directory entry format */
+    )
+{
+  DCENT *dc;
+
+
+  for (dc = dcache; dc < &dcache[_USE_DCACHE]; dc++) {
+    if (dc->id == fs->id && dc->pclust == pclust && !memcmp(dc->name, fn, 8+3))
+      return dc;
+  }
+  return NULL;
+}
+
+
+static
+void dcache_store (   /* No return code */
+    const DIR *dirobj,  /* Directory object pointing the entry */
+    const char *fn,     /* Name it was looked up by */
+    const BYTE *dptr    /* Pointer to the entry in the window */
+    )
+{
+  DCENT *dc;
+
+
+  dc = dcache_find(dirobj->fs, dirobj->sclust, fn);
+  if (!dc) {            /* Not cached yet, replace the oldest slot */
+    dc = &dcache[dcache_next];
+    if (++dcache_next >= _USE_DCACHE) dcache_next = 0;
+  }
+  dc->id = dirobj->fs->id;
+  dc->index = dirobj->index;
+  dc->pclust = dirobj->sclust;
+  dc->clust = dirobj->clust;
+  dc->sect = dirobj->sect;
+  dc->fclust = ((DWORD)LD_WORD(&dptr[DIR_FstClusHI]) << 16) | LD_WORD(&dptr[DIR_FstClusLO]);
+  memcpy(dc->name, fn, 8+3);
+  dc->attr = dptr[DIR_Attr];
+#if _USE_LFN
+  dc->back = fn[0] ? 0 : lfn_cur.n;
+#endif
+}
+
+
+#if _USE_LFN
+static
+BOOL dcache_lfn (   /* TRUE: the cached entry has the long name of lfn_cur */
+    FATFS *fs,      /* File system object */
+    const DCENT *dc   /* Slot found by the key of the long name */
+    )
+{
+  DIR scan;
+  LFNCTX lc;
+  WORD idx;
+  BYTE n;
+
+
+  /* The key matches other names of equal hash, compare the whole name */
+  idx = dc->clust ? dc->index % (fs->sects_clust * (S_SIZ / 32)) : dc->index;
+  if (idx < dc->back) return FALSE;   /* Starts in the previous cluster, scan */
+  scan.fs = fs;
+  scan.clust = dc->clust;
+  scan.index = dc->index - dc->back;
+  scan.sect = dc->sect - (dc->index / (S_SIZ / 32) - scan.index / (S_SIZ / 32));
+  lc = lfn_cur;                   /* The scan after a mismatch needs the name hash */
+  lc.ord = 0xFF;
+  for (n = 0; ; n++) {
+    if (!move_window(fs, scan.sect)) return FALSE;
+    if (lfn_feed(&lc, &scan, &fs->win[(scan.index & ((S_SIZ - 1) / 32)) * 32])) {
+      if (n != dc->back || lc.n != n || !lc.match) return FALSE;
+      lfn_cur = lc;               /* Located, as if found by the scan */
+      return TRUE;
+    }
+    if (n >= dc->back || !next_dir_entry(&scan)) return FALSE;
+  }
+}
+#endif
+
+
+static
+void dcache_flush (void)  /* No return code */
+{
+  memset(dcache, 0, sizeof(dcache));
+  dcache_next = 0;
+}
+#endif /* _USE_DCACHE */
+
+
+
+
+#if _USE_DIRINDEX
+/*-----------------------------------------------------------------------*/
+/* Directory index                                                       */
+/*-----------------------------------------------------------------------*/
+
+typedef struct _DIXENT
+{
+  DWORD key[2];   /* Name packed 6 bits per character, orders as the name */
+  DWORD sect;     /* Sector containing the entry */
+  BYTE slot;      /* Entry in the sector */
+  BYTE back;      /* Number of LFN entries before it */
+  WORD lhash;     /* Upper half of the long name hash */
+}
+DIXENT;
+
+static struct
+{
+  WORD id;        /* Mount ID of the owner file system (0: no index) */
+  WORD n;         /* Number of entries in ent[] */
+  DWORD sclust;   /* Start cluster of the indexed directory (0: static root) */
+  BYTE full;      /* The directory has more entries than ent[] can hold */
+  DIXENT ent[_USE_DIRINDEX];  /* Entries sorted by key */
+} dix;
+
+
+static
+void dix_key (    /* No return code */
+    DWORD *key,     /* Key to return */
+    const BYTE *fn    /* Name in directory entry format */
+    )
+{
+  BYTE n, c;
+
+
+  /* Characters ' '..'_' (all of 8.3 names but a few symbols and DBCS) map
+     to 0..63 in order, others to 63. The last 2 bits of the 11th are lost,
+     equal keys do not mean equal names. */
+  key[0] = key[1] = 0;
+  for (n = 0; n < 8+3; n++) {
+    c = fn[n];
+    c = (c >= 0x20 && c < 0x60) ? c - 0x20 : 63;
+    if (n < 5)
+      key[0] = (key[0] << 6) | c;
+    else if (n == 5) {
+      key[0] = (key[0] << 2) | (c >> 4);
+      key[1] = c & 15;
+    } else if (n < 10)
+      key[1] = (key[1] << 6) | c;
+    else
+      key[1] = (key[1] << 4) | (c >> 2);
+  }
+}
+
+
+static
+int dix_cmp (     /* <0, 0, >0: ent sorts before, with, after the key */
+    const DIXENT *ent,
+    const DWORD *key
+    )
+{
+  if (ent->key[0] != key[0]) return (ent->key[0] < key[0]) ? -1 : 1;
+  if (ent->key[1] != key[1]) return (ent->key[1] < key[1]) ? -1 : 1;
+  return 0;
+}
+
+
+static
+WORD dix_bound (  /* Index of the first entry sorting after (upper) or not before the key */
+    const DWORD *key,
+    BYTE upper
+    )
+{
+  WORD lo = 0, hi = dix.n, mid;
+
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (dix_cmp(&dix.ent[mid], key) < (int)upper)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+
+static
+void dix_insert (   /* No return code */
+    const FATFS *fs,  /* File system object, fs->win[] holds the entry */
+    const BYTE *dptr, /* Pointer to the entry in the window */
+    BYTE back,      /* Number of LFN entries of its long name (0: none) */
+    WORD lhash      /* Upper half of the long name hash */
+    )
+{
+  DWORD key[2];
+  DIXENT *ent;
+  WORD i;
+
+
+  if (dix.n >= _USE_DIRINDEX) {   /* Grown out of the index */
+    dix.full = 1; return;
+  }
+  dix_key(key, &dptr[DIR_Name]);
+  i = dix_bound(key, 1);          /* Equal names keep the directory order */
+  ent = &dix.ent[i];
+  memmove(ent + 1, ent, (dix.n - i) * sizeof(DIXENT));
+  dix.n++;
+  ent->key[0] = key[0];
+  ent->key[1] = key[1];
+  ent->sect = fs->winsect;
+  ent->slot = (dptr - fs->win) / 32;
+  ent->back = back;
+  ent->lhash = lhash;
+}
+
+
+static
+void dix_rewind (   /* No return code */
+    DIR *dirobj     /* Directory object to point the first entry of its directory */
+    )
+{
+  FATFS *fs = dirobj->fs;
+  DWORD clust = dirobj->sclust;
+
+
+  dirobj->clust = clust;
+  if (clust) {    /* Dynamic table, skip the dot entries but of FAT32 root */
+    dirobj->sect = clust2sect(fs, clust);
+    dirobj->index = (fs->fs_type == FS_FAT32 && clust == fs->dirbase) ? 0 : 2;
+  } else {      /* Static table */
+    dirobj->sect = fs->dirbase;
+    dirobj->index = 0;
+  }
+}
+
+
+static
+FRESULT dix_open (  /* FR_OK: index ready, FR_DENIED: too large to index, FR_RW_ERROR: disk error */
+    const DIR *dirobj /* Directory object of the directory to index */
+    )
+{
+  DIR scan;
+  BYTE *dptr;
+  FATFS *fs = dirobj->fs;
+#if _USE_LFN
+  LFNCTX lc;
+  BYTE lfn;
+#endif
+
+
+  if (dix.id != fs->id || dix.sclust != dirobj->sclust) {   /* Index another directory */
+    dix.id = 0;
+    dix.n = 0;
+    dix.full = 0;
+    dix.sclust = dirobj->sclust;
+    scan = *dirobj;
+    dix_rewind(&scan);
+#if _USE_LFN
+    lfn_init(&lc, NULL, 0);
+#endif
+    do {
+      if (!move_window(fs, scan.sect)) return FR_RW_ERROR;
+      dptr = &fs->win[(scan.index & ((S_SIZ - 1) / 32)) * 32];
+      if (dptr[DIR_Name] == 0) break;       /* End of directory */
+#if _USE_LFN
+      lfn = lfn_feed(&lc, &scan, dptr);
+      if (lfn)
+        dix_insert(fs, dptr, lc.n, (WORD)(lc.hash >> 16));
+      else
+#endif
+      if (dptr[DIR_Name] != 0xE5 && !(dptr[DIR_Attr] & AM_VOL))
+        dix_insert(fs, dptr, 0, 0);
+    } while (!dix.full && next_dir_entry(&scan));
+    dix.id = fs->id;
+  }
+  return dix.full ? FR_DENIED : FR_OK;
+}
+
+
+static
+void dix_point (    /* No return code */
+    DIR *dirobj,    /* Directory object of the indexed directory to point to the entry */
+    const DIXENT *ent
+    )
+{
+  DWORD sect = ent->sect;
+  FATFS *fs = dirobj->fs;
+
+
+  /* Point the directory object to the entry, as the scan would have */
+  dirobj->sect = sect;
+  if (dirobj->sclust) {
+    sect -= fs->database;
+    dirobj->clust = sect / fs->sects_clust + 2;
+    dirobj->index = (WORD)(sect % fs->sects_clust) * (S_SIZ / 32);
+  } else {
+    dirobj->index = (WORD)(sect - fs->dirbase) * (S_SIZ / 32);
+  }
+  dirobj->index += ent->slot;
+}
+
+
+#if _USE_LFN
+static
+FRESULT dix_lfn (   /* FR_OK: read (and matched), FR_NO_FILE: no match, FR_DENIED: out of reach, FR_RW_ERROR */
+    DIR *dirobj,    /* Directory object of the indexed directory, pointed to the entry on FR_OK */
+    const DIXENT *ent,  /* Entry with a long name */
+    LFNCTX *lc      /* Long name context to read it with */
+    )
+{
+  DIR scan;
+  WORD idx;
+  BYTE n;
+  FATFS *fs = dirobj->fs;
+
+
+  scan = *dirobj;
+  dix_point(&scan, ent);
+  idx = scan.index;
+  if (idx < ent->back) return FR_DENIED;  /* Starts in the previous cluster */
+  idx -= ent->back;
+  scan.sect -= scan.index / (S_SIZ / 32) - idx / (S_SIZ / 32);
+  scan.index = idx;
+  lc->ord = 0xFF;
+  for (n = 0; ; n++) {
+    if (!move_window(fs, scan.sect)) return FR_RW_ERROR;
+    if (lfn_feed(lc, &scan, &fs->win[(scan.index & ((S_SIZ - 1) / 32)) * 32])) {
+      if (n != ent->back || lc->n != n || !lc->match) return FR_NO_FILE;
+      *dirobj = scan;
+      return FR_OK;
+    }
+    if (n >= ent->back || !next_dir_entry(&scan)) return FR_NO_FILE;
+  }
+}
+#endif
+
+
+static
+FRESULT dix_find (  /* FR_OK: found, FR_NO_FILE: not in the directory, FR_DENIED: not indexed, FR_RW_ERROR */
+    DIR *dirobj,    /* Directory to search, pointed to the entry when found */
+    const char *fn,   /* Name in directory entry format (or key of a long name) */
+    BYTE **dir      /* Pointer to the entry in the window to return */
+    )
+{
+  DWORD key[2];
+  DIXENT *ent;
+  WORD i;
+  FRESULT res;
+  FATFS *fs = dirobj->fs;
+#if _USE_LFN
+  const char *name;
+  WORD lhash;
+#endif
+
+
+  res = dix_open(dirobj);
+  if (res != FR_OK) return res;
+
+  if (fn[0]) {            /* By 8.3 name */
+    dix_key(key, (const BYTE*)fn);
+    for (i = dix_bound(key, 0); i < dix.n && !dix_cmp(&dix.ent[i], key); i++) {
+      ent = &dix.ent[i];
+      if (!move_window(fs, ent->sect)) return FR_RW_ERROR;
+      if (memcmp(&fs->win[ent->slot * 32 + DIR_Name], fn, 8+3)) continue;
+#if _USE_LFN
+      lfn_cur.n = 0;
+      if (ent->back) {    /* Locate its long name, it goes with the entry */
+        name = lfn_cur.name;
+        lfn_cur.name = NULL;
+        res = dix_lfn(dirobj, ent, &lfn_cur);
+        lfn_cur.name = name;
+        if (res != FR_OK) return (res == FR_RW_ERROR) ? res : FR_DENIED;
+      }
+#endif
+      dix_point(dirobj, ent);
+      *dir = &fs->win[ent->slot * 32];
+      return FR_OK;
+    }
+  }
+#if _USE_LFN
+  lhash = (WORD)(lfn_cur.hash >> 16);   /* By long name, read the ones of equal hash */
+  for (i = 0; i < dix.n; i++) {
+    ent = &dix.ent[i];
+    if (!ent->back || ent->lhash != lhash) continue;
+    res = dix_lfn(dirobj, ent, &lfn_cur);
+    if (res == FR_NO_FILE) continue;
+    if (res == FR_OK) *dir = &fs->win[ent->slot * 32];
+    return res;
+  }
+#endif
+  return FR_NO_FILE;
+}
+
+
+static
+void dix_update (   /* No return code */
+    FATFS *fs,      /* File system object */
+    DWORD sclust,   /* Start cluster of the directory containing the entry */
+    const BYTE *dptr  /* Pointer to the created or deleted entry in the window */
+    )
+{
+  WORD i;
+  BYTE slot = (dptr - fs->win) / 32;
+
+
+  if (dix.id != fs->id) return;
+  for (i = 0; i < dix.n; i++) {   /* Drop the old record of the slot */
+    if (dix.ent[i].sect == fs->winsect && dix.ent[i].slot == slot) {
+      dix.n--;
+      memmove(&dix.ent[i], &dix.ent[i + 1], (dix.n - i) * sizeof(DIXENT));
+      break;
+    }
+  }
+  if (dix.sclust == sclust && dptr[DIR_Name] != 0xE5 && dptr[DIR_Name] != 0)
+    dix_insert(fs, dptr, 0, 0);     /* Created entries have no long name */
+}
+#endif /* _USE_DIRINDEX */
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Find an entry in a directory                                          */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT dir_find (  /* FR_OK: found, FR_NO_FILE: not in the directory, FR_RW_ERROR: disk error */
+    DIR *dirobj,    /* Directory to search, pointed to the entry when found */
+    const char *fn,   /* Name in directory entry format (or key of a long name) */
+    BYTE **dir      /* Pointer to the entry in the window to return */
+    )
+{
+  BYTE *dptr;
+  FATFS *fs = dirobj->fs;
+#if _USE_LFN
+  BYTE lfn;
+
+
+  lfn_cur.ord = 0xFF;
+#endif
+  for (;;) {
+    if (!move_window(fs, dirobj->sect)) return FR_RW_ERROR;
+    dptr = &fs->win[(dirobj->index & ((S_SIZ - 1) / 32)) * 32]; /* Pointer to the directory entry */
+    if (dptr[DIR_Name] == 0) return FR_NO_FILE;   /* Has it reached to end of dir? */
+#if _USE_LFN
+    lfn = lfn_feed(&lfn_cur, dirobj, dptr);
+    if (lfn && lfn_cur.match) break;        /* Matched the long name? */
+#endif
+    if (dptr[DIR_Name] != 0xE5            /* Matched? */
+        && !(dptr[DIR_Attr] & AM_VOL)
+        && !memcmp(&dptr[DIR_Name], fn, 8+3) ) break;
+    if (!next_dir_entry(dirobj))          /* Next directory pointer */
+      return FR_NO_FILE;
+  }
+#if _USE_LFN
+  if (!lfn) lfn_cur.n = 0;      /* It has no long name */
+#endif
+  *dir = dptr;
+  return FR_OK;
 }
 
 
@@ -489,7 +1386,7 @@ md_l2:
 static
 FRESULT trace_path (  /* FR_OK(0): successful, !=0: error code */
     DIR *dirobj,    /* Pointer to directory object to return last directory */
-    char *fn,     /* Pointer to last segment name to return {file(8),ext(3),attr(1)} */
+    char *fn,     /* Pointer to last segment name to return {file(8),ext(3),attr(1)}, fn[0] = 0 for a long name */
     const char *path, /* Full-path string to trace a file or directory */
     BYTE **dir      /* Directory pointer in Win[] to retutn */
     )
@@ -497,7 +1394,15 @@ FRESULT trace_path (  /* FR_OK(0): successful, !=0: error code */
   DWORD clust;
   char ds;
   BYTE *dptr = NULL;
+  FRESULT res;
   FATFS *fs = dirobj->fs; /* Get logical drive from the given DIR structure */
+#if _USE_DCACHE
+  DCENT *dc;
+#endif
+#if _USE_LFN
+  const char *seg;
+  WORD nlen;
+#endif
 
 
   /* Initialize directory object */
@@ -516,22 +1421,58 @@ FRESULT trace_path (  /* FR_OK(0): successful, !=0: error code */
   }
 
   for (;;) {
+#if _USE_LFN
+    seg = path;
+    for (nlen = 0; seg[nlen] != '\0' && seg[nlen] != '/'; nlen++) ;
+#endif
     ds = make_dirfile(&path, fn);     /* Get a paragraph into fn[] */
+#if _USE_LFN
+    lfn_init(&lfn_cur, seg, nlen);
+    if (ds == 1 && nlen > 0 && nlen <= 255) { /* Not an 8.3 name, look it up by long name */
+      lfn_key(fn, &lfn_cur);
+      path = seg + nlen;
+      ds = *path ? *path++ : 0;
+    }
+#endif
     if (ds == 1) return FR_INVALID_NAME;
-    for (;;) {
-      if (!move_window(fs, dirobj->sect)) return FR_RW_ERROR;
-      dptr = &fs->win[(dirobj->index & ((S_SIZ - 1) / 32)) * 32]; /* Pointer to the directory entry */
-      if (dptr[DIR_Name] == 0)            /* Has it reached to end of dir? */
-        return !ds ? FR_NO_FILE : FR_NO_PATH;
-      if (dptr[DIR_Name] != 0xE5            /* Matched? */
-          && !(dptr[DIR_Attr] & AM_VOL)
-          && !memcmp(&dptr[DIR_Name], fn, 8+3) ) break;
-      if (!next_dir_entry(dirobj))          /* Next directory pointer */
-        return !ds ? FR_NO_FILE : FR_NO_PATH;
+#if _USE_DCACHE
+    dc = dcache_find(fs, dirobj->sclust, fn);
+#if _USE_LFN
+    if (dc && !fn[0] && !dcache_lfn(fs, dc)) dc = NULL;
+#endif
+    if (dc && ds) {                 /* Cached intermediate directory, no disk access */
+      if (!(dc->attr & AM_DIR)) return FR_NO_PATH;
+      clust = dc->fclust;
+    } else {
+      if (dc) {                   /* Cached last segment, load and verify the entry */
+        if (!move_window(fs, dc->sect)) return FR_RW_ERROR;
+        dptr = &fs->win[(dc->index & ((S_SIZ - 1) / 32)) * 32];
+        if (dptr[DIR_Name] != 0xE5  /* A long name key is not in the entry */
+            && (fn[0] ? !memcmp(&dptr[DIR_Name], fn, 8+3) : !(dptr[DIR_Attr] & AM_VOL))) {
+          dirobj->clust = dc->clust;
+          dirobj->sect = dc->sect;
+          dirobj->index = dc->index;
+          *dir = dptr; return FR_OK;
+        }
+        dc->id = 0;               /* Stale slot, fall back to the directory scan */
+      }
+#endif
+#if _USE_DIRINDEX
+      res = ds ? FR_DENIED : dix_find(dirobj, fn, &dptr); /* Index the directory of the last segment */
+      if (res == FR_DENIED)
+#endif
+      res = dir_find(dirobj, fn, &dptr);
+      if (res != FR_OK)
+        return (res == FR_NO_FILE && ds) ? FR_NO_PATH : res;
+#if _USE_DCACHE
+      dcache_store(dirobj, fn, dptr);         /* Remember where the segment was found */
+#endif
+      if (!ds) { *dir = dptr; return FR_OK; }       /* Matched with end of path */
+      if (!(dptr[DIR_Attr] & AM_DIR)) return FR_NO_PATH;  /* Cannot trace because it is a file */
+      clust = ((DWORD)LD_WORD(&dptr[DIR_FstClusHI]) << 16) | LD_WORD(&dptr[DIR_FstClusLO]); /* Get cluster# of the directory */
+#if _USE_DCACHE
     }
-    if (!ds) { *dir = dptr; return FR_OK; }       /* Matched with end of path */
-    if (!(dptr[DIR_Attr] & AM_DIR)) return FR_NO_PATH;  /* Cannot trace because it is a file */
-    clust = ((DWORD)LD_WORD(&dptr[DIR_FstClusHI]) << 16) | LD_WORD(&dptr[DIR_FstClusLO]); /* Get cluster# of the directory */
+#endif
     dirobj->clust = dirobj->sclust = clust;       /* Restart scanning at the new directory */
     dirobj->sect = clust2sect(fs, clust);
     dirobj->index = 2;
@@ -607,18 +1548,11 @@ BYTE check_fs (   /* 0:The FAT boot record, 1:Valid boot record but not an FAT,
     DWORD sect    /* Sector# (lba) to check if it is a FAT boot record or not */
     )
 {
-	char isFat[4] = {0};
-	int i;
   if (diskRead(fs->drive, fs->win, sect, 1) != DRESULT_OK)  /* Load boot record */
     return 2;
 	
   if (LD_WORD(&fs->win[BS_55AA]) != 0xAA55)        /* Check record signature (always offset 510) */
     return 2;
-	
-
-isFat[0] = fs->win[BS_FilSysType];
-isFat[1] = fs->win[BS_FilSysType+1];
-isFat[2] = fs->win[BS_FilSysType+2];
 
   if (!memcmp(&fs->win[BS_FilSysType], "FAT", 3))     /* Check FAT signature */
     return 0;
@@ -755,13 +1689,19 @@ FRESULT auto_mount (    /* FR_OK(0): successful, !=0: any error occured */
   /* Load fsinfo sector if needed */
   if (fmt == FS_FAT32) {
     fs->fsi_sector = bootsect + LD_WORD(&fs->win[BPB_FSInfo]);
-    if (diskRead(0, fs->win, fs->fsi_sector, 1) == DRESULT_OK &&
+    if (move_window(fs, fs->fsi_sector) &&
         LD_WORD(&fs->win[BS_55AA]) == 0xAA55 &&
         LD_DWORD(&fs->win[FSI_LeadSig]) == 0x41615252 &&
         LD_DWORD(&fs->win[FSI_StrucSig]) == 0x61417272) {
       fs->last_clust = LD_DWORD(&fs->win[FSI_Nxt_Free]);
       fs->free_clust = LD_DWORD(&fs->win[FSI_Free_Count]);
     }
+    /* Trust the free count only if the volume was left clean, otherwise it
+       is recounted by f_scanfree in the background. */
+    if (move_window(fs, fs->fatbase) && (fs->win[4 + 3] & 0x08))
+      fs->vol_clean = 1;
+    else
+      fs->free_clust = 0xFFFFFFFF;
   }
 #endif
 #endif
@@ -853,6 +1793,12 @@ FRESULT f_mount (BYTE drv, FATFS *fs)
 
   fsobj = FatFs [drv];
   FatFs [drv] = fs;
+#if _USE_DCACHE
+  dcache_flush();
+#endif
+#if _USE_DIRINDEX
+  dix.id = 0;
+#endif
 
   if (fsobj) 
     memset (fsobj, 0, sizeof (FATFS));
@@ -893,17 +1839,26 @@ FRESULT f_open (
   /* Trace the file path */
   res = trace_path(&dirobj, fn, path, &dir);
 #if !_FS_READONLY
+#if _USE_DCACHE
+  if (mode & (FA_WRITE|FA_CREATE_ALWAYS|FA_OPEN_ALWAYS|FA_CREATE_NEW))
+    dcache_flush();   /* The directory is going to be modified */
+#endif
   /* Create or Open a file */
   if (mode & (FA_CREATE_ALWAYS|FA_OPEN_ALWAYS|FA_CREATE_NEW)) {
     DWORD ps, rs;
     if (res != FR_OK) {   /* No file, create new */
-printf("\n NOFILE-create new \n");
       if (res != FR_NO_FILE) return res;
+#if _USE_LFN
+      if (!fn[0]) return FR_INVALID_NAME;   /* Long names are not created */
+#endif
       res = reserve_direntry(&dirobj, &dir);
       if (res != FR_OK) return res;
       memset(dir, 0, 32);           /* Initialize the new entry with open name */
       memcpy(&dir[DIR_Name], fn, 8+3);
       dir[DIR_NTres] = fn[11];
+#if _USE_DIRINDEX
+      dix_update(fs, dirobj.sclust, dir);
+#endif
       mode |= FA_CREATE_ALWAYS;
     }
     else {          /* Any object is already existing */
@@ -1034,6 +1989,50 @@ fr_error: /* Abort this file due to an unrecoverable error */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Get the Card Sectors Holding the Data at the R/W Pointer              */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_nextsect (
+    FIL *fp,    /* Pointer to the file object */
+    DWORD *sect,  /* Pointer to return the sector to be read next, 0: end of file */
+    BYTE *count   /* Pointer to return the number of contiguous sectors from there */
+    )
+{
+  DWORD clust, n;
+  FRESULT res;
+  FATFS *fs = fp->fs;
+
+
+  *sect = 0; *count = 0;
+  res = validate(fs, fp->id);     /* Check validity of the object */
+  if (res) return res;
+  if (fp->flag & FA__ERROR) return FR_RW_ERROR;
+  if (fp->fptr >= fp->fsize) return FR_OK;
+
+  if (fp->fptr & (S_SIZ - 1)) {       /* Inside the current sector */
+    *sect = fp->curr_sect;
+    n = fp->sect_clust;
+  } else if (fp->fptr && fp->sect_clust > 1) {  /* Next sector in the cluster */
+    *sect = fp->curr_sect + 1;
+    n = fp->sect_clust - 1;
+  } else {                  /* Top of the next cluster */
+    clust = fp->fptr ? get_cluster(fs, fp->curr_clust) : fp->org_clust;
+    if (clust == 1) return FR_RW_ERROR;
+    if (clust < 2 || clust >= fs->max_clust) return FR_OK;
+    *sect = clust2sect(fs, clust);
+    n = fs->sects_clust;
+  }
+
+  clust = (fp->fsize - fp->fptr + (fp->fptr & (S_SIZ - 1)) + S_SIZ - 1) / S_SIZ;
+  if (n > clust) n = clust;     /* Not beyond the end of file */
+  *count = (n > 255) ? 255 : (BYTE)n;
+  return FR_OK;
+}
+
+
+
+
 #if !_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* Write File                                                            */
@@ -1148,7 +2147,7 @@ FRESULT f_sync (
       ST_DWORD(&dir[DIR_FileSize], fp->fsize);    /* Update file size */
       ST_WORD(&dir[DIR_FstClusLO], fp->org_clust); /* Update start cluster */
       ST_WORD(&dir[DIR_FstClusHI], fp->org_clust >> 16);
-//      tim = get_fattime();          /* Updated time */
+      tim = get_fattime();          /* Updated time */
       ST_DWORD(&dir[DIR_WrtTime], tim);
       fp->flag &= ~FA__WRITTEN;
       res = sync(fs);
@@ -1157,6 +2156,162 @@ FRESULT f_sync (
   return res;
 }
 
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write Back the FAT Window and Pending FAT Copies                      */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_flush (
+    BYTE drv    /* Logical drive number */
+    )
+{
+  FATFS *fs;
+
+
+  if (drv >= _DRIVES || !(fs = FatFs[drv])) return FR_NOT_ENABLED;
+  if (!fs->fs_type) return FR_OK;     /* Not mounted, nothing cached */
+  if (!move_window(fs, 0)) return FR_RW_ERROR;
+#if _FS_MIRROR_DEFER
+  if (!flush_mirror(fs)) return FR_RW_ERROR;
+#endif
+  return FR_OK;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Allocate Clusters to an Empty File in Advance                         */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_prealloc (
+    FIL *fp,    /* Pointer to the file object */
+    DWORD size  /* Number of bytes the file is expected to grow to */
+    )
+{
+  DWORD csize, ncl, run, scl, clust, cstat, n;
+  FRESULT res;
+  FATFS *fs = fp->fs;
+
+
+  res = validate(fs, fp->id);     /* Check validity of the object */
+  if (res) return res;
+  if (fp->flag & FA__ERROR) return FR_RW_ERROR;
+  if (!(fp->flag & FA_WRITE)) return FR_DENIED;
+  if (fp->org_clust) return FR_DENIED;  /* The file already has a cluster chain */
+  if (!size) return FR_OK;
+
+  csize = (DWORD)fs->sects_clust * S_SIZ;
+  ncl = (size + csize - 1) / csize;   /* Number of clusters needed */
+
+#if _USE_FREEMAP
+  if (!fmap_build(fs)) goto fp_error;
+  if (fs->fmap_valid == 1 && fs->free_clust < ncl) return FR_DENIED;
+#endif
+
+  /* Search a contiguous free run, starting after the last allocation */
+  scl = 0; run = 0;
+  clust = fs->last_clust + 1;
+  for (n = fs->max_clust - 2; n && run < ncl; n--, clust++) {
+    if (clust < 2 || clust >= fs->max_clust) {  /* Wrap around */
+      clust = 2; run = 0;
+    }
+#if _USE_FREEMAP
+    if (fs->fmap_valid == 1 && !fs->fmap[clust / FMAP_EPG(fs)]) {
+      run = 0;          /* A full group breaks any run, step over it */
+      cstat = FMAP_EPG(fs) - clust % FMAP_EPG(fs) - 1;
+      if (cstat >= n) break;
+      n -= cstat; clust += cstat;
+      continue;
+    }
+#endif
+    cstat = get_cluster(fs, clust);
+    if (cstat == 1) goto fp_error;
+    if (cstat == 0) {
+      if (!run) scl = clust;
+      run++;
+    } else {
+      run = 0;
+    }
+  }
+
+  if (run == ncl) {           /* Link the run into a chain */
+    for (clust = scl, n = ncl; n > 1; n--, clust++) {
+      if (!put_cluster(fs, clust, clust + 1)) goto fp_error;
+    }
+    if (!put_cluster(fs, clust, 0x0FFFFFFF)) goto fp_error;
+    fs->last_clust = clust;
+    if (fs->free_clust != 0xFFFFFFFF) {
+      fs->free_clust -= ncl;
+#if _USE_FSINFO
+      fs->fsi_flag = 1;
+#endif
+    }
+  } else {                /* Fragmented volume, chain single clusters */
+    scl = clust = create_chain(fs, 0);
+    for (n = ncl; clust >= 2 && --n; )
+      clust = create_chain(fs, clust);
+    if (clust == 1) goto fp_error;
+    if (clust == 0) {           /* Disk full, give the clusters back */
+      if (scl >= 2 && !remove_chain(fs, scl)) goto fp_error;
+      return FR_DENIED;
+    }
+  }
+
+  fp->org_clust = scl;
+  fp->flag |= FA__WRITTEN;        /* Start cluster goes to the entry at sync */
+  return FR_OK;
+
+fp_error: /* Abort this file due to an unrecoverable error */
+  fp->flag |= FA__ERROR;
+  return FR_RW_ERROR;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Truncate File at the R/W Pointer                                      */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_truncate (
+    FIL *fp   /* Pointer to the file object */
+    )
+{
+  DWORD ncl;
+  FRESULT res;
+  FATFS *fs = fp->fs;
+
+
+  res = validate(fs, fp->id);     /* Check validity of the object */
+  if (res) return res;
+  if (fp->flag & FA__ERROR) return FR_RW_ERROR;
+  if (!(fp->flag & FA_WRITE)) return FR_DENIED;
+
+  if (fp->fptr < fp->fsize)
+    fp->fsize = fp->fptr;
+  if (fp->fptr == 0) {          /* Remove the whole chain */
+    if (!remove_chain(fs, fp->org_clust)) goto ft_error;
+    fp->org_clust = 0;
+    fp->sect_clust = 1;
+  } else {                /* Remove the clusters after the current one */
+    ncl = get_cluster(fs, fp->curr_clust);
+    if (ncl == 1) goto ft_error;
+    if (ncl >= 2 && ncl < fs->max_clust) {
+      if (!put_cluster(fs, fp->curr_clust, 0x0FFFFFFF) || !remove_chain(fs, ncl))
+        goto ft_error;
+    }
+  }
+  fp->flag |= FA__WRITTEN;
+  return FR_OK;
+
+ft_error: /* Abort this file due to an unrecoverable error */
+  fp->flag |= FA__ERROR;
+  return FR_RW_ERROR;
+}
+
 #endif /* !_FS_READONLY */
 
 
@@ -1295,7 +2450,8 @@ FRESULT f_opendir (
   if (res == FR_OK) {           /* Trace completed */
     if (dir != NULL) {          /* It is not the root dir */
       if (dir[DIR_Attr] & AM_DIR) {   /* The entry is a directory */
-        dirobj->clust = ((DWORD)LD_WORD(&dir[DIR_FstClusHI]) << 16) | LD_WORD(&dir[DIR_FstClusLO]);
+        dirobj->clust = dirobj->sclust =
+          ((DWORD)LD_WORD(&dir[DIR_FstClusHI]) << 16) | LD_WORD(&dir[DIR_FstClusLO]);
         dirobj->sect = clust2sect(fs, dirobj->clust);
         dirobj->index = 2;
       } else {            /* The entry is not a directory */
@@ -1303,6 +2459,9 @@ FRESULT f_opendir (
       }
     }
     dirobj->id = fs->id;
+#if _USE_DIRINDEX
+    dirobj->order = 0;
+#endif
   }
   return res;
 }
@@ -1321,20 +2480,34 @@ FRESULT f_readdir (
 {
   BYTE *dir, c, res;
   FATFS *fs = dirobj->fs;
+#if _USE_LFN
+  LFNCTX lc;
+  BYTE lfn;
+#endif
 
 
   res = validate(fs, dirobj->id);     /* Check validity of the object */
   if (res) return (FRESULT) res;
 
   finfo->fname[0] = 0;
+#if _USE_LFN
+  lfn_init(&lc, NULL, 0);
+#endif
   while (dirobj->sect) {
     if (!move_window(fs, dirobj->sect))
       return FR_RW_ERROR;
     dir = &fs->win[(dirobj->index & ((S_SIZ - 1) >> 5)) * 32];  /* pointer to the directory entry */
     c = *dir;
     if (c == 0) break;                /* Has it reached to end of dir? */
-    if (c != 0xE5 && !(dir[DIR_Attr] & AM_VOL))   /* Is it a valid entry? */
+#if _USE_LFN
+    lfn = lfn_feed(&lc, dirobj, dir);   /* Assemble the long name in front of it */
+#endif
+    if (c != 0xE5 && !(dir[DIR_Attr] & AM_VOL)) { /* Is it a valid entry? */
       get_fileinfo(finfo, dir);
+#if _USE_LFN
+      if (lfn && lc.len < _LFN_BUF) finfo->lfname = lfn_buf;
+#endif
+    }
     if (!next_dir_entry(dirobj)) dirobj->sect = 0;  /* Next entry */
     if (finfo->fname[0]) break;           /* Found valid entry */
   }
@@ -1345,6 +2518,60 @@ FRESULT f_readdir (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Read Directory Entry in Name Order                                    */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_readdir_sorted (
+    DIR *dirobj,    /* Pointer to the directory object */
+    FILINFO *finfo    /* Pointer to file information to return */
+    )
+{
+#if _USE_DIRINDEX
+  DIXENT *ent;
+  FRESULT res;
+  FATFS *fs = dirobj->fs;
+#if _USE_LFN
+  DIR scan;
+  LFNCTX lc;
+#endif
+
+
+  res = validate(fs, dirobj->id);     /* Check validity of the object */
+  if (res) return res;
+
+  res = dix_open(dirobj);
+  if (res == FR_DENIED)           /* Too large, read it in the directory order */
+    return f_readdir(dirobj, finfo);
+  if (res != FR_OK) return res;
+
+  finfo->fname[0] = 0;
+  if (dirobj->order < dix.n) {
+    ent = &dix.ent[dirobj->order++];
+#if _USE_LFN
+    res = FR_NO_FILE;
+    if (ent->back) {          /* Read its long name */
+      scan = *dirobj;
+      lfn_init(&lc, NULL, 0);
+      res = dix_lfn(&scan, ent, &lc);
+      if (res == FR_RW_ERROR) return res;
+    }
+#endif
+    if (!move_window(fs, ent->sect)) return FR_RW_ERROR;
+    get_fileinfo(finfo, &fs->win[ent->slot * 32]);
+#if _USE_LFN
+    if (res == FR_OK && lc.len < _LFN_BUF) finfo->lfname = lfn_buf;
+#endif
+  }
+  return FR_OK;
+#else
+  return f_readdir(dirobj, finfo);
+#endif
+}
+
+
+
+
 #if _FS_MINIMIZE == 0
 /*-----------------------------------------------------------------------*/
 /* Get File Status                                                       */
@@ -1401,6 +2628,11 @@ FRESULT f_getfree (
   if (res != FR_OK) return res;
   *fatfs = fs;
 
+#if _USE_FREEMAP
+  /* Completing the free map scan counts the free clusters as well */
+  if (fs->free_clust > fs->max_clust - 2 && !fmap_build(fs)) return FR_RW_ERROR;
+#endif
+
   /* If number of free cluster is valid, return it without cluster scan. */
   if (fs->free_clust <= fs->max_clust - 2) {
     *nclust = fs->free_clust;
@@ -1445,6 +2677,29 @@ FRESULT f_getfree (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Scan the FAT in the Background                                        */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_scanfree (
+    BYTE drv,     /* Logical drive number */
+    WORD nsect    /* Number of FAT sectors to scan in this call */
+    )
+{
+#if _USE_FREEMAP
+  FATFS *fs;
+
+
+  if (drv >= _DRIVES || !(fs = FatFs[drv])) return FR_NOT_ENABLED;
+  if (!fs->fs_type) return FR_OK;     /* Not mounted yet, nothing to do */
+  if (!fmap_scan(fs, nsect)) return FR_RW_ERROR;
+#endif
+  return FR_OK;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Delete a File or a Directory                                          */
 /*-----------------------------------------------------------------------*/
@@ -1465,6 +2720,9 @@ FRESULT f_unlink (
   if (res != FR_OK) return res;
   dirobj.fs = fs;
 
+#if _USE_DCACHE
+  dcache_flush();   /* Before the trace, a cache hit does not locate the long name */
+#endif
   res = trace_path(&dirobj, fn, path, &dir);  /* Trace the file path */
   if (res != FR_OK) return res;       /* Trace failed */
   if (dir == NULL) return FR_INVALID_NAME;  /* It is the root directory */
@@ -1485,9 +2743,17 @@ FRESULT f_unlink (
     } while (next_dir_entry(&dirobj));
   }
 
+#if _USE_LFN
+  if (!lfn_remove(fs, &lfn_cur)) return FR_RW_ERROR;  /* Remove its long name */
+#endif
   if (!move_window(fs, dsect)) return FR_RW_ERROR;  /* Mark the directory entry 'deleted' */
   dir[DIR_Name] = 0xE5;
   fs->winflag = 1;
+#if _USE_DIRINDEX
+  dix_update(fs, dirobj.sclust, dir);
+  if ((dir[DIR_Attr] & AM_DIR) && dix.sclust == dclust)
+    dix.id = 0;   /* Its clusters may hold another directory later */
+#endif
   if (!remove_chain(fs, dclust)) return FR_RW_ERROR;  /* Remove the cluster chain */
 
   return sync(fs);
@@ -1518,6 +2784,12 @@ FRESULT f_mkdir (
   res = trace_path(&dirobj, fn, path, &dir);  /* Trace the file path */
   if (res == FR_OK) return FR_EXIST;      /* Any file or directory is already existing */
   if (res != FR_NO_FILE) return res;
+#if _USE_LFN
+  if (!fn[0]) return FR_INVALID_NAME;     /* Long names are not created */
+#endif
+#if _USE_DCACHE
+  dcache_flush();
+#endif
 
   res = reserve_direntry(&dirobj, &dir);    /* Reserve a directory entry */
   if (res != FR_OK) return res;
@@ -1540,7 +2812,7 @@ FRESULT f_mkdir (
   memset(&fw[DIR_Name], ' ', 8+3);      /* Create "." entry */
   fw[DIR_Name] = '.';
   fw[DIR_Attr] = AM_DIR;
- // tim = get_fattime();
+  tim = get_fattime();
   ST_DWORD(&fw[DIR_WrtTime], tim);
   memcpy(&fw[32], &fw[0], 32); fw[33] = '.';  /* Create ".." entry */
   pclust = dirobj.sclust;
@@ -1561,6 +2833,9 @@ FRESULT f_mkdir (
   ST_DWORD(&dir[DIR_WrtTime], tim);     /* Crated time */
   ST_WORD(&dir[DIR_FstClusLO], dclust);    /* Table start cluster */
   ST_WORD(&dir[DIR_FstClusHI], dclust >> 16);
+#if _USE_DIRINDEX
+  dix_update(fs, dirobj.sclust, dir);
+#endif
 
   return sync(fs);
 }
@@ -1620,21 +2895,33 @@ FRESULT f_rename (
   DIR dirobj;
   char fn[8+3+1];
   FATFS *fs;
+#if _USE_LFN
+  LFNCTX lfn_old;
+#endif
 
 
   res = auto_mount(&path_old, &fs, 1);
   if (res != FR_OK) return res;
   dirobj.fs = fs;
 
+#if _USE_DCACHE
+  dcache_flush();   /* Before the trace, a cache hit does not locate the long name */
+#endif
   res = trace_path(&dirobj, fn, path_old, &dir_old);  /* Check old object */
   if (res != FR_OK) return res;     /* The old object is not found */
   if (!dir_old) return FR_NO_FILE;
   sect_old = fs->winsect;         /* Save the object information */
   memcpy(direntry, &dir_old[DIR_Attr], 32-11);
+#if _USE_LFN
+  lfn_old = lfn_cur;
+#endif
 
   res = trace_path(&dirobj, fn, path_new, &dir_new);  /* Check new object */
   if (res == FR_OK) return FR_EXIST;      /* The new object name is already existing */
   if (res != FR_NO_FILE) return res;      /* Is there no old name? */
+#if _USE_LFN
+  if (!fn[0]) return FR_INVALID_NAME;     /* Long names are not created */
+#endif
   res = reserve_direntry(&dirobj, &dir_new);  /* Reserve a directory entry */
   if (res != FR_OK) return res;
 
@@ -1642,9 +2929,92 @@ FRESULT f_rename (
   memcpy(&dir_new[DIR_Name], fn, 8+3);
   dir_new[DIR_NTres] = fn[11];
   fs->winflag = 1;
+#if _USE_DIRINDEX
+  dix_update(fs, dirobj.sclust, dir_new);
+#endif
 
+#if _USE_DCACHE
+  dcache_flush();
+#endif
+#if _USE_LFN
+  if (!lfn_remove(fs, &lfn_old)) return FR_RW_ERROR;  /* Remove the old long name */
+#endif
   if (!move_window(fs, sect_old)) return FR_RW_ERROR; /* Remove old entry */
   dir_old[DIR_Name] = 0xE5;
+#if _USE_DIRINDEX
+  dix_update(fs, dirobj.sclust, dir_old);
+#endif
+
+  return sync(fs);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Replace the Contents of a File with Another File                      */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_replace (
+    const char *path_src, /* Pointer to the file with the new contents, removed */
+    const char *path_dst  /* Pointer to the existing file, keeps its name */
+    )
+{
+  FRESULT res;
+  DWORD sect_src, sclust_src, clust_dst;
+  BYTE *dir_src, *dir_dst, direntry[32-DIR_FstClusHI];
+  DIR dirobj;
+  char fn[8+3+1];
+  FATFS *fs, *fs_dst;
+#if _USE_LFN
+  LFNCTX lfn_src;
+#endif
+
+
+  res = auto_mount(&path_src, &fs, 1);
+  if (res != FR_OK) return res;
+  res = auto_mount(&path_dst, &fs_dst, 1);
+  if (res != FR_OK) return res;
+  if (fs_dst != fs) return FR_INVALID_DRIVE;  /* Both files on one drive */
+  dirobj.fs = fs;
+
+#if _USE_DCACHE
+  dcache_flush();   /* Before the trace, a cache hit does not locate the long name */
+#endif
+  res = trace_path(&dirobj, fn, path_src, &dir_src);  /* Check source file */
+  if (res != FR_OK) return res;
+  if (!dir_src) return FR_NO_FILE;
+  if (dir_src[DIR_Attr] & AM_DIR) return FR_DENIED;
+  sect_src = fs->winsect;         /* Save cluster, time and size */
+  sclust_src = dirobj.sclust;
+  memcpy(direntry, &dir_src[DIR_FstClusHI], 32-DIR_FstClusHI);
+#if _USE_LFN
+  lfn_src = lfn_cur;
+#endif
+
+  res = trace_path(&dirobj, fn, path_dst, &dir_dst);  /* Check destination file */
+  if (res != FR_OK) return res;
+  if (!dir_dst) return FR_NO_FILE;
+  if (dir_dst[DIR_Attr] & (AM_DIR | AM_RDO)) return FR_DENIED;
+  if (fs->winsect == sect_src && dir_dst == dir_src) return FR_DENIED;  /* Same file */
+
+  clust_dst = ((DWORD)LD_WORD(&dir_dst[DIR_FstClusHI]) << 16) | LD_WORD(&dir_dst[DIR_FstClusLO]);
+  memcpy(&dir_dst[DIR_FstClusHI], direntry, 32-DIR_FstClusHI); /* Take over the new chain */
+  fs->winflag = 1;
+
+#if _USE_DCACHE
+  dcache_flush();
+#endif
+#if _USE_LFN
+  if (!lfn_remove(fs, &lfn_src)) return FR_RW_ERROR;  /* Remove the source long name */
+#endif
+  if (!move_window(fs, sect_src)) return FR_RW_ERROR; /* Remove source entry */
+  dir_src[DIR_Name] = 0xE5;
+  fs->winflag = 1;
+#if _USE_DIRINDEX
+  dix_update(fs, sclust_src, dir_src);
+#endif
+  if (!remove_chain(fs, clust_dst)) return FR_RW_ERROR; /* Free the old contents */
 
   return sync(fs);
 }
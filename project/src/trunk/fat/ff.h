@@ -68,6 +68,50 @@
 /* When _USE_NTFLAG is set to 1, upper/lower case of the file name is preserved.
 /  Note that the files are always accessed in case insensitive. */
 
+#define _USE_DCACHE 8
+/* Number of path components remembered by the directory entry cache. Each
+/  slot maps {parent dir cluster, 8.3 name} to the location of the matching
+/  entry, so repeated f_stat/f_open of the same path skips the directory scans
+/  (about 32 bytes of RAM per slot). Set to 0 to disable the cache. */
+
+#define _USE_LFN    1
+/* When _USE_LFN is set to 1, files and directories can be looked up by their
+/  long (VFAT) names and f_readdir returns them in FILINFO.lfname. A long name
+/  is compared with the path while its entries are read, case-insensitively
+/  as Latin-1, so no name buffer is needed for a lookup. The names returned
+/  by f_readdir are assembled in one shared buffer of _LFN_BUF bytes. New
+/  files and directories still get 8.3 names only. */
+
+#define _LFN_BUF    256
+/* Size of the shared long name buffer. Longer names are listed by 8.3 name. */
+
+#define _USE_DIRINDEX 128
+/* Number of entries in the index of the directory searched or listed last.
+/  The index keeps the entries sorted by name with their location, so a file
+/  is found with one sector read and f_readdir_sorted lists the directory in
+/  name order. It is built by one scan of the directory and kept up to date
+/  when entries are created or removed. Larger directories are searched by
+/  the linear scan (16 bytes of RAM per entry). Set to 0 to disable the index. */
+
+#define _FS_MIRROR_DEFER 8
+/* Number of FAT sectors whose copies in the second FAT may be left behind.
+/  A dirty FAT sector is written to the first FAT when it leaves the window,
+/  the other copies are written once at sync (f_sync, f_close, f_flush) or
+/  when the list is full. Set to 0 to write all copies at once. */
+
+#define _USE_FREEMAP 256
+/* Number of free cluster counters kept for a FAT16/FAT32 volume, one per
+/  group of FAT sectors. The counters are built by a single FAT scan on the
+/  first allocation or f_getfree and kept up to date afterwards, so the
+/  allocator skips full groups without reading them (2 bytes of RAM per
+/  counter). Set to 0 to disable the map. */
+
+#ifndef _FS_STATS
+#define _FS_STATS   0
+#endif
+/* When _FS_STATS is set to 1, FAT entry accesses and window transfers are
+/  counted in ff_stats. Meant for the host benchmark (host/ffbench). */
+
 #include "sysdefs.h"
 
 //
@@ -99,7 +143,17 @@ typedef struct _FATFS
 #if _USE_FSINFO
     DWORD fsi_sector;     /* fsinfo sector */
     BYTE  fsi_flag;       /* fsinfo dirty flag (1:must be written back) */
-    BYTE  pad2;
+    BYTE  vol_clean;      /* Clean flag in FAT[1] is set on the disk, fsinfo can be trusted */
+#endif
+#if _USE_FREEMAP
+    DWORD fmap_next;      /* Next FAT sector to be scanned into the free map */
+    BYTE  fmap_valid;     /* Free map status (0:not built, 1:valid, 2:not usable, 3:scanning) */
+    BYTE  fmap_shift;     /* FAT sectors per free map group (log2) */
+    WORD  fmap[_USE_FREEMAP]; /* Free clusters in each group of FAT sectors */
+#endif
+#if _FS_MIRROR_DEFER
+    DWORD mirror[_FS_MIRROR_DEFER]; /* FAT sectors not yet copied to the other FATs */
+    BYTE  n_mirror;       /* Number of entries in mirror[] */
 #endif
 #endif
     BYTE  fs_type;        /* FAT sub type */
@@ -126,6 +180,9 @@ typedef struct _DIR
     DWORD sclust;     /* Start cluster */
     DWORD clust;      /* Current cluster */
     DWORD sect;       /* Current sector */
+#if _USE_DIRINDEX
+    WORD order;       /* Next entry in name order (f_readdir_sorted) */
+#endif
 } 
 /* __attribute__ ((packed)) */ DIR;
 
@@ -161,6 +218,9 @@ typedef struct _FILINFO
     WORD ftime;              /* Time */
     BYTE fattrib;             /* Attribute */
     char fname [8+1+3+1];   /* Name (8.3 format) */
+#if _USE_LFN
+    char *lfname;           /* Long name in the shared buffer, valid up to the next call of the module (NULL: none) */
+#endif
 } 
 /* __attribute__ ((packed)) */ FILINFO;
 
@@ -189,6 +249,22 @@ extern const PARTITION Drives [];   /* Logical drive# to physical location conve
 
 #include "disk.h"
 
+//
+//  Access counters (_FS_STATS)
+//
+#if _FS_STATS
+typedef struct _FFSTATS
+{
+    DWORD fat_gets;       /* FAT entries read (get_cluster) */
+    DWORD fat_puts;       /* FAT entries written (put_cluster) */
+    DWORD win_reads;      /* Sectors loaded into a window */
+    DWORD win_writes;     /* Dirty windows written back */
+}
+FFSTATS;
+
+extern FFSTATS ff_stats;
+#endif
+
 //
 //  File function return code (FRESULT) 
 //
@@ -219,18 +295,25 @@ void    f_printerror (FRESULT d);              /* Print DRESULT error code */
 FRESULT f_mount (BYTE, FATFS*);                   /* Mount/Unmount a logical drive */
 FRESULT f_open (FIL*, const char*, BYTE);         /* Open or create a file */
 FRESULT f_read (FIL*, void*, WORD, WORD*);        /* Read data from a file */
+FRESULT f_nextsect (FIL*, DWORD*, BYTE*);         /* Get the card sectors at the R/W pointer */
 FRESULT f_write (FIL*, const void*, WORD, WORD*); /* Write data to a file */
 FRESULT f_lseek (FIL*, DWORD);                    /* Move file pointer of a file object */
 FRESULT f_close (FIL*);                         /* Close an open file object */
 FRESULT f_opendir (DIR*, const char*);          /* Open an existing directory */
 FRESULT f_readdir (DIR*, FILINFO*);             /* Read a directory item */
+FRESULT f_readdir_sorted (DIR*, FILINFO*);      /* Read a directory item in name order */
 FRESULT f_stat (const char*, FILINFO*);         /* Get file status */
 FRESULT f_getfree (const char*, DWORD*, FATFS**); /* Get number of free clusters on the drive */
+FRESULT f_scanfree (BYTE, WORD);                /* Build the free cluster map a few sectors at a time */
 FRESULT f_sync (FIL*);                          /* Flush cached data of a writing file */
+FRESULT f_flush (BYTE);                         /* Write back cached FAT sectors of a drive */
+FRESULT f_prealloc (FIL*, DWORD);               /* Allocate clusters to an empty file in advance */
+FRESULT f_truncate (FIL*);                      /* Truncate a file at the R/W pointer */
 FRESULT f_unlink (const char*);                 /* Delete an existing file or directory */
 FRESULT f_mkdir (const char*);                  /* Create a new directory */
 FRESULT f_chmod (const char*, BYTE, BYTE);          /* Change file/dir attriburte */
 FRESULT f_rename (const char*, const char*);    /* Rename/Move a file or directory */
+FRESULT f_replace (const char*, const char*);   /* Replace the contents of a file with another file */
 FRESULT f_mkfs (BYTE, BYTE, BYTE);                    /* Create a file system on the drive */
 
 //
@@ -326,6 +409,8 @@ DWORD get_fattime (void); /* 31-25: Year(0-127 org.1980), 24-21: Month(1-12), 20
 #define DIR_WrtDate         24
 #define DIR_FstClusLO       26
 #define DIR_FileSize        28
+#define LDIR_Ord            0
+#define LDIR_Chksum         13
 
 //
 //  Multi-byte word access macros  
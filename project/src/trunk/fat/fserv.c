@@ -1,21 +1,33 @@
 #include "fserv.h"
 #include "debug.h"
+#include "timer.h"
+#include "spi1.h"
 //#include "lcd.h"
 
 #define DIR_LST_SIZE	(4 * 1024)
 
 #define IP_COOKIE "0:/ip.bin"
 
+#define RA_STREAMS	4	// Files followed for sequential reads.
+#define RA_SECTORS	3	// Sectors read ahead for each (one TCP segment).
+
+#define REMAP_FILE	"0:/BADBLK.SYS"
+#define UPLOAD_TMP	"0:/UPLOAD.TMP"	// New contents of a replaced file.
+#define REMAP_SECTORS	(1 + 2 * DISK_REMAP_SLOTS)	// Table, then spares.
+#define SCAN_PERIOD	(CLOCK_SECOND / 10)	// Background card scan, a sector each.
+
 // Simple html for directory listing from Apache2.2 server.
 // TODO: generate more decorated / informative documents.
 static char html_head[] = "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 3.2 Final//EN\"> \
 <html> \
     <head> \
-	<title>Index of %s</title> \
+	<title>Index of ";
+
+static char html_dir[] = "</title> \
     </head> \
-    <body>\n";
+    <body>\n<h1>Index of ";
 
-static char html_dir[] = "<h1>Index of %s</h1>\n";
+static char html_dir_end[] = "</h1>\n";
 
 //static char html_elem[] = "<ul><li><a href=\"%s%s%s\"> %s</a></li></ul>\n";
 
@@ -25,7 +37,9 @@ static char file_icon[] = "/icons/file.gif";
 // [icon] [link] [link_name] [size]
 static char html_elem[] = "<tr> \
     <td valign=\"top\"><img src=\"%s\"></td> \
-    <td><a href=\"%s%s%s\">%s</a></td>\n";
+    <td><a href=\"";
+static char html_elem_link[] = "\">";
+static char html_elem_end[] = "</a></td>\n";
 
 static char html_elem_size[] = "<td align=\"right\">%d</td></tr>";
 static char html_elem_nosize[] = "<td align=\"right\">-</td></tr>";
@@ -39,19 +53,165 @@ static char html_elem_head[] = "<table> \
 
 static char html_elem_foot[] = "<tr><th colspan=\"3\"><hr></th></tr> \
 </table> \
-<address>LPC2148 NAS (uIP/1.0) Server at %s Port 80</address>\n";
+<address>LPC2148 NAS (uIP/1.0) Server Port 80</address>\n";
 
 static char html_foot[] = "</body></html>\n";
 
 
 FATFS fsdat; // Global file system container.
 
+static struct timer scan_timer;
+static BOOL remap_done;   // Spare area given to the disk layer, or failed.
+
+// Spare area for bad sectors: a hidden system file of REMAP_SECTORS
+// contiguous sectors. A card that has one uses it from the mount, others
+// get it once a failing or slow sector is noted (create).
+static void remapInit(BOOL create)
+{
+   FIL f;
+   DWORD first, sect, ofs;
+   BYTE count, fresh = 0;
+   FRESULT res;
+
+   res = f_open(&f, REMAP_FILE, FA_READ);
+   if (res == FR_NO_FILE && !create)
+      return;
+   remap_done = TRUE;
+   if (res == FR_NO_FILE) {
+      fresh = 1;
+      res = f_open(&f, REMAP_FILE, FA_CREATE_NEW | FA_WRITE);
+      if (res == FR_OK) {
+         res = f_prealloc(&f, REMAP_SECTORS * 512);
+         if (res == FR_OK) res = f_lseek(&f, REMAP_SECTORS * 512);
+         if (f_close(&f) != FR_OK && res == FR_OK) res = FR_RW_ERROR;
+      }
+      if (res == FR_OK) res = f_chmod(REMAP_FILE, AM_SYS | AM_HID, AM_SYS | AM_HID);
+      if (res == FR_OK) res = f_open(&f, REMAP_FILE, FA_READ);
+   }
+   if (res != FR_OK) {
+      pmesg(MSG_WARN, "fserv: no spare area for bad sectors (%d)\n", res);
+      return;
+   }
+
+   // The disk layer is given the first sector only.
+   first = 0;
+   for (ofs = 0; ofs < REMAP_SECTORS * 512; ofs += count * 512) {
+      if (f_lseek(&f, ofs) != FR_OK || f_nextsect(&f, &sect, &count) != FR_OK || !sect)
+         break;
+      if (!first)
+         first = sect;
+      else if (sect != first + ofs / 512)
+         break;
+   }
+   f_close(&f);
+   if (ofs < REMAP_SECTORS * 512) {
+      pmesg(MSG_WARN, "fserv: %s is not %d contiguous sectors\n", REMAP_FILE, REMAP_SECTORS);
+      return;
+   }
+   diskRemapInit(0, first, REMAP_SECTORS, fresh);
+}
+
 FRESULT fsInit()
 {
-   int r = SPI_Init();
+   FRESULT res;
+
+   SPI_Init();
+   res = f_mount(0, &fsdat);
+   remap_done = FALSE;
+   if (res == FR_OK)
+      remapInit(FALSE);
+   timer_set(&scan_timer, SCAN_PERIOD);
+   return res;
+}
+
+// There is no real time clock, files are stamped 1 Jan 1980 0:00.
+DWORD get_fattime(void)
+{
+   return (1UL << 21) | (1UL << 16);
+}
+
+// Read-ahead: a file read again where the previous read ended is
+// streamed, its next sectors are fetched while waiting for the ACK.
+typedef struct
+{
+   DWORD clust;   // Start cluster of the file, identifies it.
+   DWORD next;    // Offset the next sequential read starts at.
+   DWORD sect;    // Sector to read ahead, 0: nothing pending.
+   BYTE count;
+} raStream;
+
+static raStream ra_streams[RA_STREAMS];
+static BYTE ra_victim;
+
+static void readAheadNote(FIL* file, int offset, int bytesRead)
+{
+   raStream* ra;
+   int i;
 
-   if (r) return FR_NOT_READY;
-   return f_mount(0, &fsdat);
+   for (i = 0; i < RA_STREAMS; i++) {
+      ra = &ra_streams[i];
+      if (ra->clust == file->org_clust && ra->next == (DWORD)offset)
+         break;
+   }
+   if (i == RA_STREAMS) {
+      // Not a continuation. Start following it, but don't read ahead
+      // until it proves sequential.
+      ra = &ra_streams[ra_victim];
+      if (++ra_victim >= RA_STREAMS) ra_victim = 0;
+      ra->clust = file->org_clust;
+      ra->next = offset + bytesRead;
+      ra->sect = 0;
+      return;
+   }
+   ra->next = offset + bytesRead;
+   if (f_nextsect(file, &ra->sect, &ra->count) != FR_OK)
+      ra->sect = 0;
+   if (ra->count > RA_SECTORS)
+      ra->count = RA_SECTORS;
+}
+
+static int readAhead(void)
+{
+   raStream* ra;
+   int i;
+
+   for (i = 0; i < RA_STREAMS; i++) {
+      ra = &ra_streams[i];
+      if (ra->sect) {
+         diskPrefetch(0, ra->sect, ra->count);
+         ra->sect = 0;
+         return 1;   // One at a time, the network may need the loop.
+      }
+   }
+   return 0;
+}
+
+static struct timer flush_timer;
+
+int fsIdle(void)
+{
+   int busy;
+
+   busy = readAhead();
+   f_scanfree(0, 4);
+#if _USE_FREEMAP
+   if (fsdat.fmap_valid == 3) busy = 1;   // Free count not done yet.
+#endif
+
+   // Find failing sectors before the clients do, the volume only.
+   if (timer_expired(&scan_timer) && fsdat.fs_type) {
+      timer_reset(&scan_timer);
+      diskScan(0, fsdat.database + (fsdat.max_clust - 2) * fsdat.sects_clust);
+      if (!remap_done && diskHealthStats()->pending)
+         remapInit(TRUE);
+   }
+
+   /* Bound how long the second FAT may lag behind the first one. */
+   if (timer_expired(&flush_timer)) {
+      timer_set(&flush_timer, CLOCK_SECOND * 2);
+      f_flush(0);
+   }
+   return busy;
 }
 
 char fspath[MAX_PATH_LEN];
@@ -95,7 +255,8 @@ FRESULT fsGetElementInfo(const char* path, fsElemType* elemType, DWORD* byteSize
          pmesg(MSG_DEBUG, "fserv: invalid path err! \n");
          return fsres;
       }
-      type = FSERV_NONEXSIT;
+      if (elemType != NULL)
+         *elemType = FSERV_NONEXSIT;
       return FR_OK;
    }
 
@@ -131,6 +292,40 @@ FRESULT fsGetElementInfo(const char* path, fsElemType* elemType, DWORD* byteSize
 
 }
 
+// Appends text to the document, escaped for HTML.
+static void appendHtml(char* dataBuff, int bufflen, const char* text)
+{
+    int len = strlen(dataBuff);
+
+    // Room for the longest escape and the terminator.
+    for (; *text && len < bufflen - 7; text++) {
+	switch (*text) {
+	case '&': len += sprintf(dataBuff + len, "&amp;"); break;
+	case '<': len += sprintf(dataBuff + len, "&lt;"); break;
+	case '>': len += sprintf(dataBuff + len, "&gt;"); break;
+	case '"': len += sprintf(dataBuff + len, "&quot;"); break;
+	default: dataBuff[len++] = *text; break;
+	}
+    }
+    dataBuff[len] = '\0';
+}
+
+// Appends a path to the document, %XX escaped for a URL. The request
+// path is decoded again in the server.
+static void appendUrl(char* dataBuff, int bufflen, const char* path)
+{
+    int len = strlen(dataBuff);
+
+    for (; *path && len < bufflen - 4; path++) {
+	if ((*path >= 'a' && *path <= 'z') || (*path >= 'A' && *path <= 'Z')
+	    || (*path >= '0' && *path <= '9') || strchr("/-_.~", *path))
+	    dataBuff[len++] = *path;
+	else
+	    len += sprintf(dataBuff + len, "%%%02X", (BYTE)*path);
+    }
+    dataBuff[len] = '\0';
+}
+
 /* Directory Content HTML consturction.
 in: directory object, directory path string, buffer to hold the data
 out: directory content html document will be written to buffer container
@@ -138,26 +333,37 @@ retval: operaiton status
 */
 FRESULT fsDirContentHtml(DIR *dirObj, const char* dirpath, char* dataBuff, int bufflen)
 {
-    int i = 0;
     FRESULT fsres = FR_OK;
     FILINFO inf;
     // Insert html header.
-    snprintf(dataBuff, bufflen, html_head, dirpath);
+    snprintf(dataBuff, bufflen, html_head);
+    appendHtml(dataBuff, bufflen, dirpath);
 
     // Insert current directory string.
-    snprintf(dataBuff + strlen(dataBuff), bufflen - strlen(dataBuff), html_dir, dirpath);
+    snprintf(dataBuff + strlen(dataBuff), bufflen - strlen(dataBuff), html_dir);
+    appendHtml(dataBuff, bufflen, dirpath);
+    snprintf(dataBuff + strlen(dataBuff), bufflen - strlen(dataBuff), html_dir_end);
 
     // Add table start and headers
     snprintf(dataBuff + strlen(dataBuff), bufflen - strlen(dataBuff), html_elem_head);
 
-    do
+    // Entries in name order, an empty name ends the directory.
+    for (;;)
     {
 	char *separator = "\0";
-	i = dirObj->index;
-	fsres = f_readdir(dirObj, &inf);
-	if(i == dirObj->index) {
+	char *name;
+	fsres = f_readdir_sorted(dirObj, &inf);
+	if (fsres != FR_OK || !inf.fname[0]) {
 	    break;
 	}
+	if (inf.fattrib & AM_HID) {
+	    continue;
+	}
+#if _USE_LFN
+	name = inf.lfname ? inf.lfname : inf.fname;
+#else
+	name = inf.fname;
+#endif
 	if (dirpath[strlen(dirpath)] != '/') //avoid double slash 
 	    separator = "/";
 	if (!strcmp(dirpath,"/"))
@@ -165,26 +371,28 @@ FRESULT fsDirContentHtml(DIR *dirObj, const char* dirpath, char* dataBuff, int b
 	    separator = "\0";
 	    dirpath ="\0";
 	}
-	if (i != dirObj->index) {
-	    int isdir = (inf.fattrib & AM_DIR);
-	    char *icon_path = (isdir) ? dir_icon : file_icon; 
-	    snprintf(dataBuff + strlen(dataBuff), bufflen - strlen(dataBuff), 
-		    html_elem, 
-		    icon_path, // icon path
-		    dirpath, separator, inf.fname, // link path
-		    inf.fname); // link name
-
-	    if(!isdir) {
-		snprintf(dataBuff + strlen(dataBuff), bufflen - strlen(dataBuff),
-			html_elem_size,
-			inf.fsize); // size
-	    }
-	    else {
-		strncat(dataBuff + strlen(dataBuff), html_elem_nosize, bufflen - strlen(dataBuff));
-	    }
+	int isdir = (inf.fattrib & AM_DIR);
+	char *icon_path = (isdir) ? dir_icon : file_icon; 
+	snprintf(dataBuff + strlen(dataBuff), bufflen - strlen(dataBuff), 
+		html_elem, 
+		icon_path); // icon path
+	// Long names may hold any character, escape them.
+	appendUrl(dataBuff, bufflen, dirpath); // link path
+	appendUrl(dataBuff, bufflen, separator);
+	appendUrl(dataBuff, bufflen, name);
+	snprintf(dataBuff + strlen(dataBuff), bufflen - strlen(dataBuff), html_elem_link);
+	appendHtml(dataBuff, bufflen, name); // link name
+	snprintf(dataBuff + strlen(dataBuff), bufflen - strlen(dataBuff), html_elem_end);
+
+	if(!isdir) {
+	    snprintf(dataBuff + strlen(dataBuff), bufflen - strlen(dataBuff),
+		    html_elem_size,
+		    inf.fsize); // size
 	}
-
-    } while (i != dirObj->index);
+	else {
+	    strncat(dataBuff + strlen(dataBuff), html_elem_nosize, bufflen - strlen(dataBuff));
+	}
+    }
 
     // Add table footer
     snprintf(dataBuff + strlen(dataBuff), bufflen - strlen(dataBuff), html_elem_foot);
@@ -203,7 +411,8 @@ FRESULT fsGetElementData(const char* path, char* dataBuff,
     FRESULT fsres = FR_OK;
     FIL file;   
     DIR dir;
-    DWORD bytesRead, byteSize;
+    DWORD byteSize;
+    WORD bytesRead;
     fsElemType type;
 
     fsres = fsGetElementInfo(path, &type, &byteSize);
@@ -229,11 +438,12 @@ FRESULT fsGetElementData(const char* path, char* dataBuff,
 
 	    fsres = f_read(&file, dataBuff, bytesToRead, &bytesRead);
 
-	    if (byteSize != bytesRead)
+	    if (fsres) return fsres;
+	    if (bytesToRead != bytesRead)
 	    {
 		return FR_RW_ERROR; 
 	    }
-	    if (fsres) return fsres;
+	    readAheadNote(&file, offset, bytesRead);
 
 	    fsres = f_close(&file);
 
@@ -271,57 +481,129 @@ FRESULT fsGetElementData(const char* path, char* dataBuff,
 
 }
 
-void fsSetIp(const unsigned char* pIp)
+static FIL upload_file;                 // File being uploaded.
+static char upload_path[MAX_PATH_LEN];  // Its path, to drop it on abort.
+static BOOL upload_open = FALSE;
+static BOOL upload_replace;             // Written to UPLOAD_TMP until done.
+
+FRESULT fsUploadBegin(const char* path, DWORD size)
+{
+    FRESULT fsres;
+    FILINFO inf;
+
+    if (upload_open) return FR_NOT_READY;
+
+    constructFsPath(path);
+    strcpy(upload_path, fspath);
+
+    // The remap table and its spares, or any other hidden or system
+    // file, are not replaced from the network.
+    if (!strcasecmp(upload_path, REMAP_FILE)) return FR_DENIED;
+    if (!strcasecmp(upload_path, UPLOAD_TMP)) return FR_DENIED;
+    upload_replace = f_stat(upload_path, &inf) == FR_OK;
+    if (upload_replace && (inf.fattrib & (AM_SYS | AM_HID | AM_DIR)))
+	return FR_DENIED;
+
+    // An existing file is kept until the new one is complete.
+    fsres = f_open(&upload_file, upload_replace ? UPLOAD_TMP : upload_path,
+		   FA_CREATE_ALWAYS | FA_WRITE);
+    pmesg(MSG_INFO, "* Receiving file %s (%lu bytes)\n", upload_path, (unsigned long) size);
+    if (fsres != FR_OK) return fsres;
+    upload_open = TRUE;
+
+    // Known size: take a contiguous run now, so the clusters are not
+    // searched and linked one by one while the data streams in.
+    if (size) {
+	fsres = f_prealloc(&upload_file, size);
+	if (fsres != FR_OK) {
+	    fsUploadEnd(FALSE);
+	    return fsres;
+	}
+    }
+    return FR_OK;
+}
+
+FRESULT fsUploadWrite(const char* data, int len)
+{
+    FRESULT fsres;
+    WORD bytesWritten;
+
+    if (!upload_open) return FR_INVALID_OBJECT;
+
+    fsres = f_write(&upload_file, data, len, &bytesWritten);
+    if (fsres == FR_OK && bytesWritten != len)
+	fsres = FR_DENIED; // Disk full.
+    return fsres;
+}
+
+FRESULT fsUploadEnd(BOOL complete)
+{
+    FRESULT fsres;
+
+    if (!upload_open) return FR_INVALID_OBJECT;
+    upload_open = FALSE;
+
+    // Give back preallocated clusters the body did not fill.
+    fsres = f_truncate(&upload_file);
+    if (fsres == FR_OK)
+	fsres = f_close(&upload_file);
+    if (fsres == FR_OK && complete && upload_replace)
+	fsres = f_replace(UPLOAD_TMP, upload_path);
+
+    if (!complete || fsres != FR_OK) {
+	pmesg(MSG_WARN, "fserv: upload of %s dropped\n", upload_path);
+	f_unlink(upload_replace ? UPLOAD_TMP : upload_path);
+	return complete ? fsres : FR_OK;
+    }
+    pmesg(MSG_INFO, "* Received file %s\n", upload_path);
+    return FR_OK;
+}
+
+void fsSetIp(const void* pLease, WORD len)
 {
    FRESULT fsres;
    FIL file; 
    WORD bytesWritten;
 
-
-
+   if (!len) {
+      f_unlink(IP_COOKIE);
+      return;
+   }
 
    fsres = f_open(&file, IP_COOKIE, FA_CREATE_ALWAYS | FA_WRITE);
-   pmesg(MSG_INFO, "open ip cookie : ___ ");
    if (fsres != FR_OK) return;
 
-// write ip 4 bytes.
-   fsres = f_write(&file, pIp, 4, &bytesWritten);
+   fsres = f_write(&file, pLease, len, &bytesWritten);
+   f_close(&file);
 
-   if (fsres != FR_OK) return;
+   // A torn cookie would be taken for a lease at the next boot.
+   if (fsres != FR_OK || bytesWritten != len) {
+      f_unlink(IP_COOKIE);
+      return;
+   }
    pmesg(MSG_INFO, "written %d bytes to ip cookie\n", bytesWritten);
-
-   fsres = f_close(&file);
-   
 }
 
-void fsGetIp(unsigned char* pIp)
+BOOL fsGetIp(void* pLease, WORD len)
 {
    FRESULT fsres;
    FIL file;
-   FILINFO inf;
    WORD bytesRead;
 
-  //default IP is zero in case of error.
-   memset(pIp, 0, 4);
-
-   fsres = f_stat(IP_COOKIE, &inf);
-
-   if ((inf.fsize < 4) || (fsres != FR_OK))
-   	return;
-
    fsres = f_open(&file, IP_COOKIE, FA_READ);
-   pmesg(MSG_INFO, "open ip cookie : ___ ");
-   if (fsres != FR_OK) return;
+   if (fsres != FR_OK) return FALSE;
 
-// write ip 4 bytes.
-   fsres = f_read(&file, pIp, 4, &bytesRead);
+   // The old 4 byte cookie or any other size is not a lease of ours.
+   if (file.fsize != len) {
+      f_close(&file);
+      return FALSE;
+   }
+   fsres = f_read(&file, pLease, len, &bytesRead);
+   f_close(&file);
 
-   if (fsres != FR_OK) return;
+   if (fsres != FR_OK || bytesRead != len) return FALSE;
    pmesg(MSG_INFO, "read %d bytes from ip cookie\n", bytesRead);
-
-   fsres = f_close(&file);
-
-   return; 
+   return TRUE;
 }
 
 
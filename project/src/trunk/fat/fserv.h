@@ -22,6 +22,18 @@ typedef enum {
 */
 FRESULT fsInit();
 
+/* File server background work, call when the main loop is idle.
+   Counts the free space of the card a few FAT sectors at a time, so
+   that the first write after boot does not have to scan the whole FAT,
+   and reads the card a sector at a time to move failing sectors to the
+   spare area (BADBLK.SYS) before a client runs into them. BADBLK.SYS is
+   created when the first failing or slow sector is noted.
+    in: none
+    out: none
+    retval: nonzero if work is left for the next call
+*/
+int fsIdle(void);
+
 /* File server element type query.
    in: path to fs element
    out: size in bytes
@@ -37,14 +49,42 @@ FRESULT fsGetElementInfo(const char* path, fsElemType* elemType, DWORD* byteSize
 FRESULT fsGetElementData(const char* path, char* dataBuff, int offset, int bytesToRead);
 
 
-/* Interface for a file system based cookie storing ip address.
+/* File server upload start. Only one upload can be open at a time.
+   in: path of the file to create or overwrite, expected size in bytes
+       (0 if unknown); a known size is allocated in advance as one
+       contiguous cluster run where possible
+   out: none
+   retval: operation status, FR_NOT_READY if another upload is open
+*/
+FRESULT fsUploadBegin(const char* path, DWORD size);
+
+/* File server upload data.
+   in: data received for the open upload, its length in bytes
+   out: data appended to the file
+   retval: operation status, FR_DENIED if the disk is full
+*/
+FRESULT fsUploadWrite(const char* data, int len);
+
+/* File server upload end.
+   in: TRUE if the whole body was received, FALSE to drop the file
+   out: clusters allocated in advance but not written are released
+   retval: operation status
+*/
+FRESULT fsUploadEnd(BOOL complete);
+
+/* Interface for a file system based cookie storing the DHCP lease.
     should be used at startup to resolve our prev. IP address.
+   in: buffer for the lease, its size
+   out: the lease as stored by fsSetIp()
+   retval: TRUE if a cookie of exactly that size was read
 */
-void fsGetIp(unsigned char* pIp);
+BOOL fsGetIp(void* pLease, WORD len);
 
 /* Interface for manipulation of the ip cookie.
+   in: the lease, its size; size 0 to forget the lease
+   out: the cookie rewritten, removed if the write failed
 */
-void fsSetIp(const unsigned char* pIp);
+void fsSetIp(const void* pLease, WORD len);
 
 #endif // _FSERV_H__
 
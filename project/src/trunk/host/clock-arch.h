@@ -0,0 +1,12 @@
+#ifndef __CLOCK_ARCH_H__
+#define __CLOCK_ARCH_H__
+
+/* Host clock for uip/timer.c, milliseconds of CLOCK_MONOTONIC. */
+
+typedef unsigned int clock_time_t;
+
+#define CLOCK_CONF_SECOND 1000
+
+#define CLOCK_MS(ms) ((ms) + 1)
+
+#endif /* __CLOCK_ARCH_H__ */
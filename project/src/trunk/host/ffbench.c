@@ -0,0 +1,492 @@
+/* FatFs benchmark on the host.
+
+   Runs fat/ff.c, fat/disk.c and fat/fserv.c against a card image file
+   (mmc_img.c) and reports, for each workload, the card blocks read and
+   written, the part of them in the FAT area, the FAT entries looked up,
+   the read-ahead hits, the modelled card time and the wall time.
+
+   usage: ffbench [options] [seq] [seek] [list] [append] [names] [scan]
+   Without a workload all but scan run. The names workload also checks
+   the long name support, the exit status is 1 if any check failed.
+      -i file   card image (ffbench.img)
+      -n sect   create a new image of this many sectors and format it
+      -c sect   sectors per cluster for the new image (4)
+      -k kHz    SPI clock (3750)
+      -r us     read access time (300)
+      -w us     write busy time (1000)
+      -0        count the card time but do not wait for it
+      -s bytes  size of the streamed file (1048576)
+      -d files  files in the listed directory (100)
+      -q reads  random reads of the seek workload (500)
+      -g us     time between the packets of the append workload (0), the
+                network work a written sector is programmed behind
+      -f n      make n sectors of the big file flaky: they fail twice
+                and then answer slowly, until moved to spare sectors
+      -t file   write the trace ring at the end, as /trace.bin (for
+                host/tracedump)
+      -v        print the file server messages
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "debug.h"
+#include "fserv.h"
+#include "mmc_img.h"
+#include "trace.h"
+
+#define SEGMENT   1646   // Segment size of the sdserver (uip_mss()).
+#define CHUNK     1460   // Upload data per received packet.
+
+#define BIG_FILE  "/BIG.BIN"
+#define LIST_DIR  "/LIST"
+#define APP_FILE  "/APPEND.BIN"
+#define NAMES_DIR "/NAMES"
+
+DEFINE_pmesg_level(MSG_WARN);
+
+extern FATFS fsdat;
+
+static DWORD big_size = 1048576;
+static int dir_files = 100;
+static int seeks = 500;
+static int flaky = 0;
+static DWORD gap_us = 0;
+static int failures = 0;
+
+static char buf[4096];
+
+typedef struct
+{
+   mmcImgStats_t card;
+   FFSTATS fs;
+   diskRaStats_t ra;
+   struct timespec t;
+} sample_t;
+
+static void take(sample_t* s)
+{
+   s->card = *mmcImgStats();
+   s->fs = ff_stats;
+   s->ra = *diskReadAheadStats();
+   clock_gettime(CLOCK_MONOTONIC, &s->t);
+}
+
+static void report(const char* name, const sample_t* a)
+{
+   sample_t b;
+   double wall;
+
+   take(&b);
+   wall = (b.t.tv_sec - a->t.tv_sec) * 1e3 + (b.t.tv_nsec - a->t.tv_nsec) / 1e6;
+   printf("%-8s %8lu %8lu %7lu %7lu %7lu %8lu %7lu %7lu %10.1f %10.1f\n", name,
+      (unsigned long)(b.card.reads - a->card.reads),
+      (unsigned long)(b.card.writes - a->card.writes),
+      (unsigned long)(b.card.fat_reads - a->card.fat_reads),
+      (unsigned long)(b.card.fat_writes - a->card.fat_writes),
+      (unsigned long)(b.card.seeks - a->card.seeks),
+      (unsigned long)(b.fs.fat_gets - a->fs.fat_gets),
+      (unsigned long)(b.ra.hits - a->ra.hits),
+      (unsigned long)(b.ra.prefetched - a->ra.prefetched),
+      (b.card.card_us - a->card.card_us) / 1e3, wall);
+}
+
+// Same segment sizes as the sdserver: whole sectors after the first one.
+static int segment(DWORD offset, DWORD left)
+{
+   int len = SEGMENT;
+
+   if (len > 512) len -= (offset + len) % 512;
+   if (left < (DWORD)len) len = left;
+   return len;
+}
+
+static FRESULT check(const char* what, FRESULT res)
+{
+   if (res != FR_OK) {
+      fprintf(stderr, "%s: error %d\n", what, res);
+      failures++;
+   }
+   return res;
+}
+
+static int expect(const char* what, int ok)
+{
+   if (!ok) {
+      fprintf(stderr, "names: %s\n", what);
+      failures++;
+   }
+   return ok;
+}
+
+// Files the workloads use, written once per image.
+static FRESULT populate(void)
+{
+   fsElemType type;
+   DWORD size, n;
+   FRESULT res;
+   char path[32];
+   int i, len;
+
+   res = fsGetElementInfo(BIG_FILE, &type, &size);
+   if (res != FR_OK || type != FSERV_FILE || size != big_size) {
+      printf("writing %s (%lu bytes)\n", BIG_FILE, (unsigned long)big_size);
+      res = fsUploadBegin(BIG_FILE, big_size);
+      for (n = 0; res == FR_OK && n < big_size; n += len) {
+         len = big_size - n < sizeof(buf) ? big_size - n : sizeof(buf);
+         memset(buf, 'a' + n / sizeof(buf) % 26, len);
+         res = fsUploadWrite(buf, len);
+      }
+      if (res == FR_OK) res = fsUploadEnd(TRUE);
+      if (check("populate " BIG_FILE, res)) return res;
+   }
+
+   res = fsGetElementInfo(LIST_DIR, &type, &size);
+   if (res != FR_OK || type != FSERV_DIR) {
+      printf("writing %s (%d files)\n", LIST_DIR, dir_files);
+      sprintf(path, "0:%s", LIST_DIR);
+      if (check("populate " LIST_DIR, f_mkdir(path))) return FR_RW_ERROR;
+      for (i = 0; i < dir_files; i++) {
+         sprintf(path, "%s/F%05d.TXT", LIST_DIR, i);
+         res = fsUploadBegin(path, 0);
+         if (res == FR_OK) res = fsUploadWrite(path, strlen(path));
+         if (res == FR_OK) res = fsUploadEnd(TRUE);
+         if (check("populate " LIST_DIR, res)) return res;
+      }
+   }
+   return f_flush(0);
+}
+
+// Stream the big file as the sdserver does, the card idles between
+// segments while the ACK is awaited.
+static void bench_seq(void)
+{
+   sample_t s;
+   DWORD offset;
+   int len;
+
+   take(&s);
+   for (offset = 0; offset < big_size; offset += len) {
+      len = segment(offset, big_size - offset);
+      if (check("seq", fsGetElementData(BIG_FILE, buf, offset, len))) break;
+      fsIdle();
+   }
+   report("seq", &s);
+}
+
+// Single segments at random offsets, the client seeking in a file.
+static void bench_seek(void)
+{
+   sample_t s;
+   DWORD offset;
+   int i;
+
+   srand(1);
+   take(&s);
+   for (i = 0; i < seeks; i++) {
+      offset = ((DWORD)rand() * 512) % big_size;
+      if (check("seek", fsGetElementData(BIG_FILE, buf, offset, segment(offset, big_size - offset))))
+         break;
+   }
+   report("seek", &s);
+}
+
+// Directory page, then every entry of it looked up by path.
+static void bench_list(void)
+{
+   sample_t s;
+   fsElemType type;
+   char path[32];
+   int i;
+
+   take(&s);
+   check("list", fsGetElementData(LIST_DIR, buf, 0, sizeof(buf)));
+   for (i = 0; i < dir_files; i++) {
+      sprintf(path, "%s/F%05d.TXT", LIST_DIR, i);
+      if (check("list", fsGetElementInfo(path, &type, NULL))) break;
+   }
+   report("list", &s);
+}
+
+// Background scan of the whole volume, as fsIdle() runs it.
+static void bench_scan(void)
+{
+   sample_t s;
+   DWORD n, sectors;
+
+   sectors = fsdat.database + (fsdat.max_clust - 2) * fsdat.sects_clust;
+   take(&s);
+   for (n = 0; n < sectors + DISK_REMAP_SLOTS; n++)
+      diskScan(0, sectors);
+   report("scan", &s);
+}
+
+// Sectors of the big file that fail and then answer slowly.
+static void make_flaky(void)
+{
+   FIL f;
+   DWORD sect, size;
+   BYTE count;
+   int i;
+
+   if (f_open(&f, "0:" BIG_FILE, FA_READ) != FR_OK) return;
+   for (i = 0; i < flaky; i++) {
+      size = (big_size / 512 / flaky * i + 1) * 512;
+      if (f_lseek(&f, size) == FR_OK && f_nextsect(&f, &sect, &count) == FR_OK && sect)
+         mmcImgFault(sect, 2, 4096);
+   }
+   f_close(&f);
+}
+
+// The main loop busy with the network until the next packet.
+static void gap(void)
+{
+   struct timespec now, end;
+
+   if (!gap_us) return;
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   end.tv_nsec += gap_us * 1000L;
+   end.tv_sec += end.tv_nsec / 1000000000;
+   end.tv_nsec %= 1000000000;
+   do
+      clock_gettime(CLOCK_MONOTONIC, &now);
+   while (now.tv_sec < end.tv_sec || (now.tv_sec == end.tv_sec && now.tv_nsec < end.tv_nsec));
+}
+
+// The ring as the web server sends it: the clock, then the events.
+static void write_trace(const char* path)
+{
+   traceEvent_t ev;
+   DWORD pos = traceStart();
+   FILE* f;
+
+   if (!(f = fopen(path, "wb"))) {
+      perror(path);
+      return;
+   }
+   traceClock(&ev);
+   do
+      fwrite(&ev, sizeof(ev), 1, f);
+   while (traceRead(&pos, &ev));
+   fclose(f);
+}
+
+// Upload of unknown length, packet by packet.
+static void bench_append(void)
+{
+   sample_t s;
+   FRESULT res;
+   DWORD n;
+
+   memset(buf, 'x', CHUNK);
+   take(&s);
+   res = fsUploadBegin(APP_FILE, 0);
+   for (n = 0; res == FR_OK && n < big_size; n += CHUNK) {
+      gap();
+      res = fsUploadWrite(buf, big_size - n < CHUNK ? big_size - n : CHUNK);
+   }
+   if (res == FR_OK) res = fsUploadEnd(TRUE);
+   if (res == FR_OK) res = f_flush(0);
+   check("append", res);
+   report("append", &s);
+}
+
+// Long names in directory order, ff.c reads them but does not create them.
+static const struct
+{
+   const char* lfn;
+   const char* sfn;     // In directory entry format.
+   const char* path;    // The 8.3 name as a path.
+} names[] = {
+   { "Zeta file.txt", "ZETAFI~1TXT", NAMES_DIR "/ZETAFI~1.TXT" },
+   { "alpha & omega.txt", "ALPHA~1 TXT", NAMES_DIR "/ALPHA~1.TXT" },
+   { "Middle name.txt", "MIDDLE~1TXT", NAMES_DIR "/MIDDLE~1.TXT" },
+};
+
+#define N_NAMES (sizeof(names) / sizeof(names[0]))
+
+// The LFN entries of a name, last part first, then its 8.3 entry.
+static BYTE* put_lfn(BYTE* e, const char* lfn, const char* sfn)
+{
+   static const BYTE ofs[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+   int len = strlen(lfn), n = (len + 12) / 13, i, k, pos;
+   BYTE sum = 0;
+   WORD w;
+
+   for (k = 0; k < 11; k++)
+      sum = ((sum & 1) ? 0x80 : 0) + (sum >> 1) + (BYTE)sfn[k];
+   for (i = n; i >= 1; i--, e += 32) {
+      memset(e, 0, 32);
+      e[LDIR_Ord] = i | (i == n ? 0x40 : 0);
+      e[DIR_Attr] = AM_LFN;
+      e[LDIR_Chksum] = sum;
+      for (k = 0; k < 13; k++) {
+         pos = (i - 1) * 13 + k;
+         w = pos < len ? (BYTE)lfn[pos] : pos == len ? 0 : 0xFFFF;
+         e[ofs[k]] = (BYTE)w;
+         e[ofs[k] + 1] = w >> 8;
+      }
+   }
+   memset(e, 0, 32);
+   memcpy(e + DIR_Name, sfn, 11);
+   e[DIR_Attr] = AM_ARC;
+   return e + 32;
+}
+
+static void names_clean(void)
+{
+   char path[32];
+   unsigned i;
+
+   for (i = 0; i < N_NAMES; i++) {
+      sprintf(path, "0:%s", names[i].path);
+      f_unlink(path);
+   }
+   f_unlink("0:" NAMES_DIR);
+}
+
+static fsElemType names_type(const char* path)
+{
+   fsElemType type = FSERV_NONEXSIT;
+
+   check("names", fsGetElementInfo(path, &type, NULL));
+   return type;
+}
+
+// Lookup by long name, the listing in name order, and removal with the
+// long name, on a directory written raw.
+static void bench_names(void)
+{
+   sample_t s;
+   DIR dir;
+   BYTE sect[512], *e;
+   char *alpha, *middle, *zeta;
+   unsigned i;
+
+   names_clean();
+   if (check("names", f_mkdir("0:" NAMES_DIR))) return;
+   if (check("names", f_opendir(&dir, "0:" NAMES_DIR))) return;
+   if (diskRead(0, sect, dir.sect, 1) != DRESULT_OK) return;
+   for (e = sect + 2 * 32, i = 0; i < N_NAMES; i++)     // After . and ..
+      e = put_lfn(e, names[i].lfn, names[i].sfn);
+   if (diskWrite(0, sect, dir.sect, 1) != DRESULT_OK) return;
+   if (check("names", fsInit())) return;      // Drop the cached window
+
+   take(&s);
+   expect("lookup by long name", names_type(NAMES_DIR "/Zeta file.txt") == FSERV_FILE);
+   expect("lookup in other case", names_type(NAMES_DIR "/ZETA FILE.TXT") == FSERV_FILE);
+   expect("cached lookup", names_type(NAMES_DIR "/zeta file.txt") == FSERV_FILE);
+   expect("lookup of a missing name", names_type(NAMES_DIR "/zeta file.txz") == FSERV_NONEXSIT);
+
+   memset(buf, 0, sizeof(buf));
+   check("names", fsGetElementData(NAMES_DIR, buf, 0, sizeof(buf) - 1));
+   alpha = strstr(buf, "href=\"" NAMES_DIR "/alpha%20%26%20omega.txt\">alpha &amp; omega.txt<");
+   middle = strstr(buf, ">Middle name.txt<");
+   zeta = strstr(buf, ">Zeta file.txt<");
+   expect("escaped link", alpha != NULL);
+   expect("listing in name order", alpha && middle && zeta && alpha < middle && middle < zeta);
+
+   // Renamed behind the cache: the key of the old name (hash, length and
+   // first characters) still finds the slot, the name compare rejects it.
+   put_lfn(sect + 2 * 32, "Zeta fils.txt", names[0].sfn);
+   if (diskWrite(0, sect, dir.sect, 1) != DRESULT_OK) return;
+   names_type(BIG_FILE);      // Moves the window off the directory
+   expect("cached name compared", names_type(NAMES_DIR "/Zeta file.txt") == FSERV_NONEXSIT);
+
+   check("names", f_unlink("0:" NAMES_DIR "/middle NAME.txt"));
+   expect("removed", names_type(NAMES_DIR "/Middle name.txt") == FSERV_NONEXSIT);
+   expect("others kept", names_type(NAMES_DIR "/alpha & omega.txt") == FSERV_FILE);
+   report("names", &s);
+
+   diskRead(0, sect, dir.sect, 1);
+   for (e = sect + 7 * 32; e < sect + 10 * 32; e += 32)  // Middle's LFN entries and 8.3 entry
+      expect("long name removed", e[DIR_Name] == 0xE5);
+   names_clean();
+}
+
+static const struct
+{
+   const char* name;
+   void (*run)(void);
+   int all;    // Part of the default run.
+} benches[] = {
+   { "seq", bench_seq, 1 },
+   { "seek", bench_seek, 1 },
+   { "list", bench_list, 1 },
+   { "append", bench_append, 1 },
+   { "names", bench_names, 1 },
+   { "scan", bench_scan, 0 },
+};
+
+#define N_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+int main(int argc, char** argv)
+{
+   mmcImgTiming_t timing = { 3750, 300, 1000, 1 };
+   const char* image = "ffbench.img";
+   DWORD sectors = 0;
+   BYTE clust = 4;
+   const diskHealth_t* h;
+   const char* trace = NULL;
+   unsigned i;
+   int opt, j;
+
+   while ((opt = getopt(argc, argv, "i:n:c:k:r:w:0s:d:q:g:f:t:v")) != -1) {
+      switch (opt) {
+         case 'i': image = optarg; break;
+         case 'n': sectors = strtoul(optarg, NULL, 0); break;
+         case 'c': clust = atoi(optarg); break;
+         case 'k': timing.spi_khz = strtoul(optarg, NULL, 0); break;
+         case 'r': timing.read_us = strtoul(optarg, NULL, 0); break;
+         case 'w': timing.write_us = strtoul(optarg, NULL, 0); break;
+         case '0': timing.inject = 0; break;
+         case 's': big_size = strtoul(optarg, NULL, 0); break;
+         case 'd': dir_files = atoi(optarg); break;
+         case 'q': seeks = atoi(optarg); break;
+         case 'g': gap_us = strtoul(optarg, NULL, 0); break;
+         case 'f': flaky = atoi(optarg); break;
+         case 't': trace = optarg; break;
+         case 'v': pmesg_level(MSG_INFO); break;
+         default:
+            fprintf(stderr, "usage: %s [-i image] [-n sectors] [-c clust] [-k kHz] [-r us] [-w us] [-0]\n"
+               "\t[-s bytes] [-d files] [-q reads] [-g us] [-f n] [-t file] [-v] [seq] [seek] [list] [append] [names] [scan]\n", argv[0]);
+            return 2;
+      }
+   }
+   if (timing.spi_khz == 0) timing.spi_khz = 1;
+
+   if (mmcImgOpen(image, sectors)) return 1;
+   if (check("mount", fsInit())) return 1;
+   if (sectors) {
+      printf("formatting %s (%lu sectors, %d per cluster)\n", image, (unsigned long)sectors, clust);
+      if (check("f_mkfs", f_mkfs(0, 0, clust)) || check("mount", fsInit())) return 1;
+   }
+
+   // Populate without the latency model, it is not measured.
+   mmcImgSetTiming(&(mmcImgTiming_t){ timing.spi_khz, 0, 0, 0 });
+   if (populate() != FR_OK) return 1;
+   mmcImgSetFatArea(fsdat.fatbase, fsdat.sects_fat * fsdat.n_fats);
+   mmcImgSetTiming(&timing);
+   if (flaky) make_flaky();
+
+   printf("%-8s %8s %8s %7s %7s %7s %8s %7s %7s %10s %10s\n", "workload",
+      "reads", "writes", "fat rd", "fat wr", "seeks", "lookups", "ra hit", "ra read", "card ms", "wall ms");
+   for (i = 0; i < N_BENCHES; i++) {
+      for (j = optind; j < argc && strcmp(argv[j], benches[i].name); j++)
+         ;
+      if (optind == argc ? benches[i].all : j < argc)
+         benches[i].run();
+   }
+
+   h = diskHealthStats();
+   if (h->retries || h->remapped || h->pending)
+      printf("card: %lu retries, %lu failed, %lu slow, %u remapped, %u spares left, %u pending\n",
+         (unsigned long)h->retries, (unsigned long)h->failures, (unsigned long)h->slow,
+         h->remapped, h->sparesLeft, h->pending);
+
+   if (trace) write_trace(trace);
+   mmcImgClose();
+   return failures ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+/* Host versions of the few target services the file system code uses. */
+
+#include <time.h>
+#include "type.h"
+#include "clock.h"
+#include "spi1.h"
+#include "trace.h"
+
+clock_time_t clock_time(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+const DWORD trace_clock_hz = 1000000;
+
+DWORD trace_clock(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void SPI_Init(void)
+{
+}
+
@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "type.h"
+#include "mmc.h"
+#include "mmc_img.h"
+
+#define CMD_BYTES	8	// Command frame, response and the fill byte before it.
+#define RD_BYTES	(1 + MMC_DATA_SIZE + 2)		// Token, block, CRC.
+#define WR_BYTES	(1 + MMC_DATA_SIZE + 2 + 1)	// ...and the data response.
+
+BYTE MMCWRData[MMC_DATA_SIZE];
+BYTE MMCRDData[MMC_DATA_SIZE];
+BYTE MMCCSD[16];
+BYTE MMCStatus = 0;
+DWORD MMCWait;
+BYTE MMCBusy = 0;
+
+static FILE* img;
+static DWORD img_sectors;
+static DWORD last_block;   // Block after the previous command, for seeks.
+
+static mmcImgTiming_t timing = { 3750, 300, 1000, 1 };
+static DWORD fat_first, fat_count;
+static mmcImgStats_t stats;
+static struct timespec busy_end;   // Card programming until then.
+
+#define MAX_FAULTS 16
+
+static struct
+{
+   DWORD block;
+   BYTE fails;
+   WORD wait;
+} faults[MAX_FAULTS];
+static int n_faults;
+
+int mmcImgOpen(const char* path, DWORD sectors)
+{
+   long size;
+
+   if (img) mmcImgClose();
+   img = fopen(path, sectors ? "w+b" : "r+b");
+   if (!img) {
+      perror(path);
+      return -1;
+   }
+   if (sectors) {
+      // A sparse file of the requested size, blank as a new card.
+      if (fseek(img, (long)sectors * MMC_DATA_SIZE - 1, SEEK_SET) || fputc(0, img) == EOF) {
+         perror(path);
+         mmcImgClose();
+         return -1;
+      }
+   }
+   fseek(img, 0, SEEK_END);
+   size = ftell(img);
+   img_sectors = size / MMC_DATA_SIZE;
+
+   if (img_sectors == 0) {
+      fprintf(stderr, "%s: %ld bytes, no sector\n", path, size);
+      mmcImgClose();
+      return -1;
+   }
+   return 0;
+}
+
+void mmcImgClose(void)
+{
+   if (img) fclose(img);
+   img = NULL;
+   img_sectors = 0;
+   n_faults = 0;
+}
+
+void mmcImgSetTiming(const mmcImgTiming_t* t)
+{
+   timing = *t;
+}
+
+void mmcImgSetFatArea(DWORD first, DWORD count)
+{
+   fat_first = first;
+   fat_count = count;
+}
+
+mmcImgStats_t* mmcImgStats(void)
+{
+   return &stats;
+}
+
+int mmcImgFault(DWORD block, BYTE fails, WORD wait)
+{
+   if (n_faults >= MAX_FAULTS) return -1;
+   faults[n_faults].block = block;
+   faults[n_faults].fails = fails;
+   faults[n_faults].wait = wait;
+   n_faults++;
+   return 0;
+}
+
+static void time_after(struct timespec* t, unsigned long long us)
+{
+   clock_gettime(CLOCK_MONOTONIC, t);
+   t->tv_nsec += (long)(us % 1000000) * 1000;
+   t->tv_sec += us / 1000000 + t->tv_nsec / 1000000000;
+   t->tv_nsec %= 1000000000;
+}
+
+// Spin, sleeping would round the wait up to the scheduler tick.
+static void wait_until(const struct timespec* end)
+{
+   struct timespec now;
+
+   do
+      clock_gettime(CLOCK_MONOTONIC, &now);
+   while (now.tv_sec < end->tv_sec || (now.tv_sec == end->tv_sec && now.tv_nsec < end->tv_nsec));
+}
+
+// Account for (and with inject, wait for) one block command.
+static void card_time(DWORD bytes, DWORD wait_us)
+{
+   unsigned long long us;
+   struct timespec end;
+
+   us = (unsigned long long)bytes * 8 * 1000 / timing.spi_khz + wait_us;
+   stats.card_us += us;
+   if (!timing.inject) return;
+
+   time_after(&end, us);
+   wait_until(&end);
+}
+
+static int in_fat(DWORD block)
+{
+   return block >= fat_first && block - fat_first < fat_count;
+}
+
+// Nonzero if the command on the block fails, sets MMCWait otherwise.
+static int fault(DWORD block)
+{
+   int i;
+
+   MMCWait = 0;
+   for (i = 0; i < n_faults; i++) {
+      if (faults[i].block != block) continue;
+      if (faults[i].fails) {
+         if (faults[i].fails != 0xFF) faults[i].fails--;
+         card_time(CMD_BYTES + 0xFFF, 0);  // Polled until the timeout.
+         return 1;
+      }
+      MMCWait = faults[i].wait;
+      card_time(faults[i].wait, 0);
+   }
+   return 0;
+}
+
+int mmc_init(void)
+{
+   MMCStatus = 0;
+   MMCBusy = 0;
+   last_block = 0;
+   return img ? 0 : IDLE_STATE_TIMEOUT;
+}
+
+// The image is ready at once: no idle state to poll.
+int mmc_init_start(void)
+{
+   return mmc_init();
+}
+
+int mmc_init_poll(void)
+{
+   return MMCStatus;
+}
+
+int mmc_response(BYTE response)
+{
+   return 0;
+}
+
+int mmc_read_block(DWORD block_number)
+{
+   return mmc_read_block_to(block_number, MMCRDData);
+}
+
+int mmc_read_block_to(DWORD block_number, BYTE* buf)
+{
+   if (mmc_write_finish()) return WRITE_BLOCK_FAIL;
+   if (!img || block_number >= img_sectors) return READ_BLOCK_TIMEOUT;
+   if (fault(block_number)) return READ_BLOCK_DATA_TOKEN_MISSING;
+
+   if (fseek(img, (long)block_number * MMC_DATA_SIZE, SEEK_SET)
+         || fread(buf, MMC_DATA_SIZE, 1, img) != 1)
+      return READ_BLOCK_DATA_TOKEN_MISSING;
+
+   stats.reads++;
+   if (in_fat(block_number)) stats.fat_reads++;
+   if (block_number != last_block) stats.seeks++;
+   last_block = block_number + 1;
+   card_time(CMD_BYTES + RD_BYTES, timing.read_us);
+   return 0;
+}
+
+int mmc_write_block(DWORD block_number)
+{
+   int res;
+
+   res = mmc_write_start(block_number);
+   if (res == 0) res = mmc_write_finish();
+   return res;
+}
+
+// The card programs the block while the caller goes on: the busy time
+// is counted at once but only waited for by the next command.
+int mmc_write_start(DWORD block_number)
+{
+   if (mmc_write_finish()) return WRITE_BLOCK_FAIL;
+   if (!img || block_number >= img_sectors) return WRITE_BLOCK_TIMEOUT;
+   if (fault(block_number)) return WRITE_BLOCK_FAIL;
+
+   if (fseek(img, (long)block_number * MMC_DATA_SIZE, SEEK_SET)
+         || fwrite(MMCWRData, MMC_DATA_SIZE, 1, img) != 1)
+      return WRITE_BLOCK_FAIL;
+
+   stats.writes++;
+   if (in_fat(block_number)) stats.fat_writes++;
+   if (block_number != last_block) stats.seeks++;
+   last_block = block_number + 1;
+   card_time(CMD_BYTES + WR_BYTES, 0);
+   stats.card_us += timing.write_us;
+   if (timing.inject) time_after(&busy_end, timing.write_us);
+   MMCBusy = 1;
+   return 0;
+}
+
+int mmc_write_finish(void)
+{
+   if (!MMCBusy) return 0;
+   MMCBusy = 0;
+   if (timing.inject) wait_until(&busy_end);
+   return 0;
+}
+
+void mmc_idle(WORD bytes)
+{
+   card_time(bytes, 0);
+}
+
+int mmc_wait_for_write_finish(void)
+{
+   return 0;
+}
+
+int mmc_get_csd(void)
+{
+   return 0;
+}
+
+DWORD mmc_card_capacity(void)
+{
+   return img_sectors * MMC_DATA_SIZE;
+}
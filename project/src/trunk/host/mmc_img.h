@@ -0,0 +1,64 @@
+#ifndef _MMC_IMG_H_
+#define _MMC_IMG_H_
+
+/* Host replacement of the MMC/SPI driver (arch/lpc21xx/mmc), backed by a
+   FAT image file. fat/disk.c runs on top of it unchanged, so the host
+   build exercises the same diskRead/diskWrite/diskIoctl and read-ahead
+   code as the target.
+
+   Every block command costs the time the card would take over SPI:
+   the command frame, the access (read) or busy (write) time and the
+   data block clocked at spi_khz. The time is summed in the stats and,
+   with inject set, also spent waiting so that wall time includes it.
+   The busy time of mmc_write_start() is only waited for by the next
+   command, as on the card.
+*/
+
+#include "type.h"
+
+typedef struct
+{
+   DWORD spi_khz;    // SPI clock.
+   DWORD read_us;    // Wait for the data token of a read.
+   DWORD write_us;   // Busy time after a written block.
+   BYTE inject;      // 1: wait for it, 0: only count it.
+} mmcImgTiming_t;
+
+typedef struct
+{
+   DWORD reads;       // Blocks read.
+   DWORD writes;      // Blocks written.
+   DWORD fat_reads;   // ...of which in the FAT area.
+   DWORD fat_writes;
+   DWORD seeks;       // Commands not following the previous block.
+   unsigned long long card_us;  // Modelled card time.
+} mmcImgStats_t;
+
+/* Open the card image.
+   in: image path, size in sectors to create it with (0: use the file as is)
+   out: none
+   retval: 0 on success, -1 on error (reported on stderr)
+*/
+int mmcImgOpen(const char* path, DWORD sectors);
+
+/* Close the card image. */
+void mmcImgClose(void);
+
+/* Set the latency model. */
+void mmcImgSetTiming(const mmcImgTiming_t* timing);
+
+/* Set the sectors counted as FAT area in the stats. */
+void mmcImgSetFatArea(DWORD first, DWORD count);
+
+/* Counters, reset by the caller between measurements. */
+mmcImgStats_t* mmcImgStats(void);
+
+/* Make a block flaky, for the bad sector handling of disk.c.
+   in: block, number of commands on it to fail next (0xFF: all of them),
+       response wait in bytes reported by the ones that succeed
+   out: none
+   retval: 0 on success, -1 if the fault table is full
+*/
+int mmcImgFault(DWORD block, BYTE fails, WORD wait);
+
+#endif // _MMC_IMG_H_
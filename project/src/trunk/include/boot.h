@@ -0,0 +1,30 @@
+#ifndef __BOOT_H__
+#define __BOOT_H__
+
+/* Boot profiler. Each bring-up step marks its stage when done, with a
+   trace_clock64() stamp, and bootReport() prints the stages marked since
+   its previous call in milliseconds from BOOT_CLOCK. The timer only
+   starts in clock_init(): startup.S and the first lines of main() are
+   not counted, a few milliseconds at most.
+
+   Only the first mark of a stage counts. Each stage has its own slot,
+   so the timer FIQ may mark one too. */
+
+#include "type.h"
+
+#define BOOT_CLOCK      0   /* Timer running: the time origin */
+#define BOOT_LCD        1   /* Display controller set up */
+#define BOOT_ETH        2   /* ENC28J60 configured */
+#define BOOT_CARD       3   /* Card out of its idle state */
+#define BOOT_MOUNT      4   /* File system mounted */
+#define BOOT_LOOP       5   /* uIP up, main loop entered */
+#define BOOT_IP         6   /* Address configured, stored lease or DHCP */
+#define BOOT_SERVED     7   /* First HTTP response handed to uIP */
+#define BOOT_STAGES     8
+
+void bootMark(int stage);
+
+/* Print the stages marked since the previous call, nothing if none. */
+void bootReport(void);
+
+#endif /* __BOOT_H__ */
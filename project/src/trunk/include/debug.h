@@ -9,6 +9,20 @@
 #define MSG_DEBUG       45
 #define MSG_DEBUG_MORE  60
 
+/* Messages above PMESG_LEVEL are compiled out, arguments and all, the
+   others are filtered at runtime by __msglevel. A module sets its own
+   level by defining PMESG_LEVEL before its first #include, the others
+   get PMESG_MAX_LEVEL (from the command line, MSG_DEBUG otherwise). */
+#ifndef PMESG_MAX_LEVEL
+#define PMESG_MAX_LEVEL MSG_DEBUG
+#endif
+#ifndef PMESG_LEVEL
+#define PMESG_LEVEL     PMESG_MAX_LEVEL
+#endif
+
+/* True if messages of the level are compiled in, also usable in #if. */
+#define PMESG_ON(level) ((level) <= PMESG_LEVEL)
+
 extern int __msglevel; /* the higher, the more messages... */
 
 #if defined(NDEBUG) && defined(__GNUC__)
@@ -20,9 +34,12 @@ extern int __msglevel; /* the higher, the more messages... */
     #define DEFINE_pmesg_level(level)       ((void)0)
 #else
 
-    void pmesg(int level, char *format, ...);
+    void pmesg_print(int level, char *format, ...) __attribute__ ((format (printf, 2, 3)));
     /* print a message, if it is considered significant enough.
       Adapted from [K&R2], p. 174 */
+    #define pmesg(level, format, args...)  \
+        do { if (PMESG_ON(level)) pmesg_print(level, format, ##args); } while (0)
+
     #define pmesg_level(level)  \
         __msglevel = level;
 
@@ -31,4 +48,3 @@ extern int __msglevel; /* the higher, the more messages... */
 #endif
 
 #endif /* DEBUG_H */
-
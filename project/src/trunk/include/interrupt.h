@@ -99,4 +99,23 @@ typedef enum {
 		"MSR	CPSR, R0		\n\t"	/* Write back modified value.	*/	\
 		"LDMIA	SP!, {R0}			" )	/* Pop R0.						*/
 
+/* Disable IRQ and FIQ, returning the CPSR to give back to
+   restore_interrupts(). Unlike the pair above, safe in a handler. */
+static inline uint32_t save_interrupts(void)
+{
+	uint32_t cpsr, tmp;
+
+	asm volatile (
+		"MRS	%0, CPSR		\n\t"
+		"ORR	%1, %0, #0xC0	\n\t"
+		"MSR	CPSR_c, %1"
+		: "=r" (cpsr), "=r" (tmp) : : "memory");
+	return cpsr;
+}
+
+static inline void restore_interrupts(uint32_t cpsr)
+{
+	asm volatile ("MSR	CPSR_c, %0" : : "r" (cpsr) : "memory");
+}
+
 #endif                             
@@ -0,0 +1,37 @@
+#ifndef __STACK_H__
+#define __STACK_H__
+
+/* Mode stacks set up by startup.S, from the top of RAM down: FIQ, IRQ,
+   then the system mode stack main() runs on. The heap grows up from
+   the end of .bss towards the latter.
+
+   startup.S paints everything from the end of .bss to the top of RAM
+   with STACK_PAINT before main(), so the deepest a stack has ever been
+   is where the paint stops. */
+#define FIQ_STACK_SIZE  0x100
+#define IRQ_STACK_SIZE  0x400
+#define SYS_STACK_SIZE  0x400
+
+#define STACK_PAINT     0xA5A5A5A5
+
+#ifndef __ASSEMBLER__
+#include "type.h"
+
+#define STACK_MODES     3
+
+typedef struct
+{
+    const char *name;
+    DWORD size;     /* Set up for the mode */
+    DWORD used;     /* High-water mark, size or more if overrun */
+} stackUse_t;
+
+/* High-water marks of the FIQ, IRQ and system mode stacks. */
+void stackUse(stackUse_t use[STACK_MODES]);
+
+/* RAM below the system stack that neither it nor the heap has
+   reached yet. */
+DWORD stackFreeRam(void);
+#endif
+
+#endif /* __STACK_H__ */
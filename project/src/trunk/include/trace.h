@@ -3,6 +3,7 @@
 
 #ifdef TRACE
     #include <stdio.h>
+    #undef TRACE                        /* -DTRACE defines it as 1 */
     #define TRACE(format , args...)     \
         do {	                        \
             printf(format, ##args);     \
@@ -28,4 +29,85 @@
     #define EP()  	        do{}while(0)
 #endif
 
+/* Binary event ring. A trace point stores a timestamp, an event id and
+   two arguments into RAM without any formatting, so it can stay in hot
+   paths without changing their timing. The ring is read later: printed
+   by traceDrain() over the UART when the main loop is idle, or served
+   raw as /trace.bin by the web server. host/tracedump turns either into
+   a timeline.
+
+   TRACE_EVENTS is the size of the ring in events, a power of 2; 0, the
+   default, compiles the trace points and /trace.bin out. The newest events overwrite the
+   oldest ones, a reader that falls behind gets a TEV_LOST event. The
+   ring has a single writer, the main loop: no trace points in
+   interrupt handlers. */
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 0
+#endif
+
+/* 1: the main loop prints the ring over the UART while idle. */
+#ifndef TRACE_UART
+#define TRACE_UART 0
+#endif
+
+#include "type.h"
+
+/* Event ids and their arguments (arg1, arg2). */
+#define TEV_CLOCK       0   /* -, timestamp ticks per second */
+#define TEV_LOST        1   /* -, events overwritten before being read */
+#define TEV_RX          2   /* frame length, receive status */
+#define TEV_UIP         3   /* uip_input(): UIP_DATA, uip_len */
+#define TEV_UIP_SEND    4   /* -, uip_len of the packet to send */
+#define TEV_DISK_READ   5   /* sector count, first sector */
+#define TEV_DISK_DONE   6   /* DRESULT, read-ahead hits so far */
+#define TEV_HTTP_PART   7   /* segment length, file offset */
+
+typedef struct
+{
+    DWORD time;     /* trace_clock() */
+    WORD id;        /* TEV_xxx */
+    WORD arg1;
+    DWORD arg2;
+} traceEvent_t;
+
+/* Free running timestamp, from the clock architecture. It wraps after
+   2^32 / trace_clock_hz seconds, about 12 minutes on the target. */
+DWORD trace_clock(void);
+/* The same, wide enough to never wrap. */
+uint64_t trace_clock64(void);
+extern const DWORD trace_clock_hz;
+
+#if TRACE_EVENTS
+extern traceEvent_t traceRing[TRACE_EVENTS];
+extern DWORD traceHead;     /* Events written since boot */
+
+#define TRACE_EV(id_, arg1_, arg2_)                                     \
+    do {                                                                \
+        traceEvent_t *ev_ = &traceRing[traceHead % TRACE_EVENTS];       \
+        ev_->time = trace_clock();                                      \
+        ev_->id = (id_);                                                \
+        ev_->arg1 = (arg1_);                                            \
+        ev_->arg2 = (arg2_);                                            \
+        traceHead++;                                                    \
+    } while(0)
+
+/* Position of the oldest event in the ring. */
+DWORD traceStart(void);
+
+/* Read the event at *pos and advance it. If the event has been
+   overwritten, the read gives a TEV_LOST event and skips *pos to the
+   oldest one. Returns 0 if *pos is at the newest event. */
+int traceRead(DWORD *pos, traceEvent_t *ev);
+
+/* A TEV_CLOCK event, for the reader to convert the timestamps. */
+void traceClock(traceEvent_t *ev);
+
+/* Print up to max events not printed yet over the UART, one line each:
+   "T time id arg1 arg2" in hex. Returns nonzero if events are left. */
+int traceDrain(int max);
+#else
+#define TRACE_EV(id_, arg1_, arg2_)  do{}while(0)
+#define traceDrain(max)             (0)
+#endif
+
 #endif /* __TRACE_H_ */
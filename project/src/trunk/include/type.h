@@ -30,9 +30,16 @@ typedef unsigned short	USHORT;
 typedef unsigned short	WORD;
 
 /* These types are assumed as 32-bit integer */
+#ifdef __LP64__
+/* 64-bit host build (host/), long would be 64 bits there */
+typedef signed int	LONG;
+typedef unsigned int	ULONG;
+typedef unsigned int	DWORD;
+#else
 typedef signed long	LONG;
 typedef unsigned long	ULONG;
 typedef unsigned long	DWORD;
+#endif
 
 typedef unsigned char BOOL;
 typedef unsigned char bool;
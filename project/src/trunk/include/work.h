@@ -0,0 +1,48 @@
+#ifndef __WORK_H__
+#define __WORK_H__
+
+/* Work pending bits. Interrupt handlers post a bit for what they leave
+   to the main loop, and so does the loop for what it could not finish
+   in one pass. The loop takes the bits at the top of a pass, and at the
+   bottom workSleep() stops the core clock (PCON idle mode) if nothing
+   has been posted since. Any enabled interrupt starts it again, the
+   peripherals keep running meanwhile.
+
+   The ENC28J60 INT line is not connected to the LPC, so the timer tick
+   doubles as the Ethernet poll: a frame waits at most one tick before
+   the loop reads it.
+
+   WORK_MEASURE is a period in seconds: every period the main loop
+   prints the share of time the core spent idle. 0 compiles the
+   measurement out. */
+#ifndef WORK_MEASURE
+#define WORK_MEASURE 0
+#endif
+
+#include "type.h"
+#include "io.h"
+
+#define WORK_TICK   BIT0    /* Timer tick: software timers, Ethernet poll */
+#define WORK_NET    BIT1    /* The ENC28J60 may hold more frames */
+#define WORK_UART   BIT2    /* UART0 transmit ring drained */
+#define WORK_USB    BIT3    /* USB device, no driver yet */
+#define WORK_FS     BIT4    /* File server background work left */
+#define WORK_HTTP   BIT5    /* A download waits for its turn */
+
+extern volatile DWORD workPending;
+
+/* Post work bits, from the main loop or any interrupt handler. */
+void workPost(DWORD bits);
+
+/* Take and clear the pending bits. */
+DWORD workTake(void);
+
+/* Idle mode until the next interrupt, unless work is pending. */
+void workSleep(void);
+
+#if WORK_MEASURE
+/* Idle time in 1/1000 since the previous call. */
+WORD workIdleRatio(void);
+#endif
+
+#endif /* __WORK_H__ */
@@ -53,6 +53,10 @@ memb_init(struct memb_blocks *m)
 {
   memset(m->count, 0, m->num);
   memset(m->mem, 0, m->size * m->num);
+  m->nfree = 0;
+  m->fresh = 0;
+  m->used = 0;
+  m->peak = 0;
 }
 /*---------------------------------------------------------------------------*/
 void *
@@ -60,44 +64,64 @@ memb_alloc(struct memb_blocks *m)
 {
   int i;
 
-  for(i = 0; i < m->num; ++i) {
-    if(m->count[i] == 0) {
-      /* If this block was unused, we increase the reference count to
-	 indicate that it now is used and return a pointer to the
-	 memory block. */
-      ++(m->count[i]);
-      return (void *)((char *)m->mem + (i * m->size));
-    }
+  if(m->nfree > 0) {
+    /* The block freed last. */
+    i = m->free[--m->nfree];
+  } else if(m->fresh < m->num) {
+    i = m->fresh++;
+  } else {
+    /* No free block, so we return NULL to indicate failure to
+       allocate block. */
+    return NULL;
   }
 
-  /* No free block was found, so we return NULL to indicate failure to
-     allocate block. */
-  return NULL;
+  /* Increase the reference count to indicate that the block now is
+     used and return a pointer to it. */
+  ++(m->count[i]);
+  if(++m->used > m->peak) {
+    m->peak = m->used;
+  }
+  return (void *)((char *)m->mem + (i * m->size));
+}
+/*---------------------------------------------------------------------------*/
+/* Index of the block "ptr" points to, -1 if it points to none. */
+static int
+memb_index(struct memb_blocks *m, void *ptr)
+{
+  unsigned long offset;
+
+  offset = (unsigned long)((char *)ptr - (char *)m->mem);
+  if((char *)ptr < (char *)m->mem || offset >= (unsigned long)m->size * m->num ||
+     offset % m->size != 0) {
+    return -1;
+  }
+  return offset / m->size;
 }
 /*---------------------------------------------------------------------------*/
 char
 memb_free(struct memb_blocks *m, void *ptr)
 {
   int i;
-  char *ptr2;
 
-  /* Walk through the list of blocks and try to find the block to
-     which the pointer "ptr" points to. */
-  ptr2 = (char *)m->mem;
-  for(i = 0; i < m->num; ++i) {
-    
-    if(ptr2 == (char *)ptr) {
-      /* We've found to block to which "ptr" points so we decrease the
-	 reference count and return the new value of it. */
-      if(m->count[i] > 0) {
-	/* Make sure that we don't deallocate free memory. */
-	--(m->count[i]);
-      }
-      return m->count[i];
-    }
-    ptr2 += m->size;
+  i = memb_index(m, ptr);
+  if(i < 0) {
+    return -1;
   }
-  return -1;
+
+  /* Decrease the reference count and return the new value of it, the
+     block is free again once it drops to zero. Make sure that we don't
+     deallocate free memory. */
+  if(m->count[i] > 0 && --(m->count[i]) == 0) {
+    m->free[m->nfree++] = i;
+    --m->used;
+  }
+  return m->count[i];
+}
+/*---------------------------------------------------------------------------*/
+int
+memb_inmemb(struct memb_blocks *m, void *ptr)
+{
+  return memb_index(m, ptr) >= 0;
 }
 /*---------------------------------------------------------------------------*/
 
@@ -97,18 +97,56 @@ MEMB(connections, sizeof(struct connection), 16);
  */
 #define MEMB(name, structure, num) \
         static char MEMB_CONCAT(name,_memb_count)[num]; \
+        static unsigned char MEMB_CONCAT(name,_memb_free)[num]; \
         static structure MEMB_CONCAT(name,_memb_mem)[num]; \
         static struct memb_blocks name = {sizeof(structure), num, \
                                           MEMB_CONCAT(name,_memb_count), \
-                                          (void *)MEMB_CONCAT(name,_memb_mem)}
+                                          (void *)MEMB_CONCAT(name,_memb_mem), \
+                                          MEMB_CONCAT(name,_memb_free)}
 
+/**
+ * Declare a memory block with typed allocation functions.
+ *
+ * Same as MEMB(), and also defines name_alloc(), which returns a
+ * pointer to structure, and name_free(), which only takes one.
+ * Example:
+ \code
+MEMB_TYPED(connections, struct connection, 16);
+
+struct connection *c = connections_alloc();
+connections_free(c);
+ \endcode
+ */
+#define MEMB_TYPED(name, structure, num) \
+        MEMB(name, structure, num); \
+        static inline structure *MEMB_CONCAT(name,_alloc)(void) \
+        { return (structure *)memb_alloc(&name); } \
+        static inline char MEMB_CONCAT(name,_free)(structure *ptr) \
+        { return memb_free(&name, ptr); }
+
+/*
+ * Allocation and deallocation take constant time: the free blocks are
+ * kept as a stack of indexes, blocks never allocated yet are taken in
+ * order. So a block set holds at most 255 blocks.
+ */
 struct memb_blocks {
   unsigned short size;
   unsigned short num;
   char *count;
   void *mem;
+  unsigned char *free;    /* Indexes of the freed blocks */
+  unsigned char nfree;    /* Entries in free */
+  unsigned char fresh;    /* Blocks from here on never allocated */
+  unsigned char used;     /* Blocks allocated now */
+  unsigned char peak;     /* Most blocks ever allocated at once */
 };
 
+/**
+ * Number of blocks allocated now, and the high-water mark.
+ */
+#define memb_used(m) ((m)->used)
+#define memb_peak(m) ((m)->peak)
+
 /**
  * Initialize a memory block that was declared with MEMB().
  *
@@ -137,6 +175,12 @@ void *memb_alloc(struct memb_blocks *m);
  */
 char  memb_free(struct memb_blocks *m, void *ptr);
 
+/**
+ * Check if a pointer is a block of a memory block set.
+ * \return Nonzero if "ptr" points to a block of "m".
+ */
+int memb_inmemb(struct memb_blocks *m, void *ptr);
+
 /** @} */
 
 #endif /* __MEMB_H__ */
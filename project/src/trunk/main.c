@@ -1,7 +1,11 @@
 #include <stdio.h>
+#include <string.h>
 
+#include "boot.h"
 #include "debug.h"
+#include "trace.h"
 #include "type.h"
+#include "work.h"
 
 #include "lpc214x.h"
 
@@ -12,6 +16,7 @@
 #include "uip_arp.h"
 #include "timer.h"
 #include "fserv.h"
+#include "disk.h"
 
 #include "dhcpc.h"
 
@@ -26,20 +31,38 @@
 #define MY_MAC_ADDR	{ 0x00, 0xf8, 0xc1, 0xd8, 0xc7, 0xa6} 
 #define MSG_UIP_LOG	MSG_DEBUG
 
+/* Seconds to wait for the router's ARP reply before storing the lease
+   without its MAC address. */
+#define LEASE_WAIT	5
+
 extern u16_t uip_slen;
 
 DEFINE_pmesg_level(MSG_INFO);
 
+static struct dhcpc_lease lease;	// In use.
+static struct dhcpc_lease stored;	// As in the card cookie.
+static u8_t lease_wait;		// Seconds left before storing it anyway.
+static u8_t announce;		// ARP packets to send, ANNOUNCE_ bits.
+
+#define ANNOUNCE_ADDR	0x01	// Gratuitous ARP for our address.
+#define ANNOUNCE_ROUTER	0x02	// ARP request for the router.
+
 void uip_log(char *m)
 {
     pmesg(MSG_UIP_LOG, "uIP log message: %s\n", m);
 }
 
-void pmesg_hex(int level, uint8_t *buf, unsigned int len);
+void pmesg_hex_print(int level, uint8_t *buf, unsigned int len);
+
+/* Compiled out along with the pmesg() it stands for. */
+#define pmesg_hex(level, buf, len)  \
+    do { if (PMESG_ON(level)) pmesg_hex_print(level, buf, len); } while (0)
 
-void pmesg_hex(int level, uint8_t *buf, unsigned int len) 
+void pmesg_hex_print(int level, uint8_t *buf, unsigned int len) 
 {
     unsigned int i;
+    if (level > __msglevel)
+	return;
     for(i = 0; i < len; i++) {
 	if((i % 8) == 0 && i != 0) {
 	    pmesg(level, "|");
@@ -53,44 +76,112 @@ void pmesg_hex(int level, uint8_t *buf, unsigned int len)
     pmesg(level, "\n");
 }
 
-void dhcpc_configured(const struct dhcpc_state *s) {
+static void net_configure(const struct dhcpc_lease *l) {
     char ipmsg[20] = {0};
-    uip_sethostaddr(s->ipaddr);
-    uip_setdraddr(s->default_router);
-    uip_setnetmask(s->netmask);
+    uip_sethostaddr(l->ipaddr);
+    uip_setdraddr(l->default_router);
+    uip_setnetmask(l->netmask);
   
     pmesg(MSG_INFO, "- Setting IP to: `%d.%d.%d.%d'\n", 
-	    uip_ipaddr1(s->ipaddr), 
-	    uip_ipaddr2(s->ipaddr), 
-	    uip_ipaddr3(s->ipaddr), 
-	    uip_ipaddr4(s->ipaddr));
+	    uip_ipaddr1(l->ipaddr), 
+	    uip_ipaddr2(l->ipaddr), 
+	    uip_ipaddr3(l->ipaddr), 
+	    uip_ipaddr4(l->ipaddr));
     pmesg(MSG_INFO, "- Setting default router IP to: `%d.%d.%d.%d'\n", 
-	    uip_ipaddr1(s->default_router), 
-	    uip_ipaddr2(s->default_router), 
-	    uip_ipaddr3(s->default_router), 
-	    uip_ipaddr4(s->default_router));
+	    uip_ipaddr1(l->default_router), 
+	    uip_ipaddr2(l->default_router), 
+	    uip_ipaddr3(l->default_router), 
+	    uip_ipaddr4(l->default_router));
 
-    pmesg(MSG_INFO,"*~*~*~*DHCPC CONFIGURED*~*~*~*\n\n\n");
     sprintf(ipmsg, "IP = %d.%d.%d.%d",
-	    ((u8_t*)s->ipaddr)[0],
-	    ((u8_t*)s->ipaddr)[1],
-	    ((u8_t*)s->ipaddr)[2],
-	    ((u8_t*)s->ipaddr)[3]);
+	    ((u8_t*)l->ipaddr)[0],
+	    ((u8_t*)l->ipaddr)[1],
+	    ((u8_t*)l->ipaddr)[2],
+	    ((u8_t*)l->ipaddr)[3]);
 
     lcdClearScreen(); 
     lcdPrintString(ipmsg);
+
+    lease = *l;
+    lease_wait = LEASE_WAIT;
+    bootMark(BOOT_IP);
+}
+
+/* The lease is ours: from a DHCPACK, or a stored one that no server
+   answered for. Only now may other hosts be told the address. */
+void dhcpc_configured(const struct dhcpc_state *s) {
+    net_configure(&s->lease);
+    pmesg(MSG_INFO,"*~*~*~*DHCPC CONFIGURED*~*~*~*\n\n\n");
+    announce = ANNOUNCE_ADDR | ANNOUNCE_ROUTER;
+}
+
+/* A stored lease ran out with no server confirming it: stop using the
+   address, and forget it so the next boot does not try it again. */
+void dhcpc_unconfigured(const struct dhcpc_state *s) {
+    uip_ipaddr_t addr;
+
+    uip_ipaddr(addr, 0,0,0,0);
+    uip_sethostaddr(addr);
+    pmesg(MSG_INFO, "- Dropping IP\n");
+    lcdClearScreen();
+
+    lease_wait = 0;
+    memset(&lease, 0, sizeof(lease));
+    memset(&stored, 0, sizeof(stored));
+    fsSetIp(NULL, 0);
+}
+
+/* Tell the link about the address just configured: a gratuitous ARP
+   for the caches of the other hosts, and a request for the router so
+   that its entry is resolved, or refreshed, before the first reply. */
+static void net_announce(u8_t what)
+{
+    if(what & ANNOUNCE_ADDR) {
+	uip_arp_request(uip_hostaddr);
+	network_send(uip_buf, uip_len);
+    }
+    if(what & ANNOUNCE_ROUTER) {
+	uip_arp_request(uip_draddr);
+	network_send(uip_buf, uip_len);
+    }
+    uip_len = 0;
+}
+
+/* Keep the lease for the next boot, with the router MAC address once
+   it is known. The card is only written when something changed. */
+static void lease_store(void)
+{
+    if(uip_arp_lookup(lease.default_router, (struct uip_eth_addr *)lease.router_mac)) {
+	lease_wait = 0;
+    } else if(--lease_wait) {
+	return;
+    } else {
+	memset(lease.router_mac, 0, sizeof(lease.router_mac));
+    }
+    if(memcmp(&lease, &stored, sizeof(lease)) != 0) {
+	stored = lease;
+	fsSetIp(&stored, sizeof(stored));
+    }
 }
 
 int main(void)
 {
     unsigned int i;
     uint64_t j;
+    int card, eth;
     struct uip_eth_addr macaddr = { 
 	.addr = MY_MAC_ADDR
     };
 
     uip_ipaddr_t ipaddr;
+    struct uip_conn *conn;
     struct timer periodic_timer, arp_timer;
+#if WORK_MEASURE
+    struct timer measure_timer;
+    WORD idle;
+
+    timer_set(&measure_timer, CLOCK_SECOND * WORK_MEASURE);
+#endif
 
     timer_set(&periodic_timer, CLOCK_SECOND * 1);
     timer_set(&arp_timer, CLOCK_SECOND * 1);
@@ -99,16 +190,33 @@ int main(void)
 
     fopen("uart0", "w");
 
-    fsInit();
-    lcdInit();
+    /* The tick first: it times the waits below, drives the display and
+       stamps the boot stages. */
     clock_init();
+    bootMark(BOOT_CLOCK);
 
     pmesg(MSG_INFO, "- Started Uart\n");
 
-    pmesg(MSG_INFO, "- Starting Network...");
-    network_init();
+    /* The display, the card and the ENC28J60 each start with a wait of
+       their own, let them overlap: the display sets itself up from the
+       tick, the card and the controller are polled in turns. */
+    pmesg(MSG_INFO, "- Starting Card and Network...");
+    lcdInit();
+    diskInitStart();
+    network_init_start();
+    do {
+	card = diskInitPoll();
+	if(!card)
+	    bootMark(BOOT_CARD);
+	eth = network_init_poll();
+	if(!eth)
+	    bootMark(BOOT_ETH);
+    } while(card || eth);
     pmesg(MSG_INFO, "Done\n");
 
+    fsInit();
+    bootMark(BOOT_MOUNT);
+
     pmesg(MSG_INFO, "- Starting uIP...");
     uip_init();
     pmesg(MSG_INFO, "Done\n");
@@ -123,13 +231,37 @@ int main(void)
     httpd_init();
     dhcpc_init(macaddr.addr, sizeof(macaddr.addr));
 
+    /* After a power blip ask for the previous lease back instead of
+       going through DISCOVER, the router already resolved. The address
+       stays unset until DHCP confirms it: it may belong to someone else
+       now, and the INIT-REBOOT REQUEST goes out from 0.0.0.0. */
+    if(fsGetIp(&stored, sizeof(stored))) {
+	for(i = 0; i < sizeof(stored.router_mac) && !stored.router_mac[i]; i++);
+	if(i < sizeof(stored.router_mac))
+	    uip_arp_set(stored.default_router, (struct uip_eth_addr *)stored.router_mac);
+	dhcpc_reboot(&stored);
+    }
+
+    bootMark(BOOT_LOOP);
+    bootReport();
+
     while(1) {
+	/* Whatever was posted so far, this pass handles it. */
+	workTake();
+
+	if(announce) {
+	    net_announce(announce);
+	    announce = 0;
+	    workPost(WORK_NET);
+	}
+
 	uip_len = network_read(uip_buf);
 	if(j++ % 1000 == 0) {
 	    pmesg(MSG_DEBUG, "loop %ld\n", j);
 	}
 	if(uip_len > 0) 
 	{
+	    workPost(WORK_NET);
 	    pmesg(MSG_DEBUG, "Got packet (len == %d)\n", uip_len);
 	    pmesg_hex(MSG_DEBUG_MORE, uip_buf, uip_len);
 
@@ -166,7 +298,9 @@ int main(void)
 	{
 	    //pmesg(MSG_DEBUG, "Timer expired: periodic timer (%d)\n", periodic_timer.start);
 	    timer_reset(&periodic_timer);
-	    
+
+	    if(lease_wait)
+		lease_store();
 
    	    for(i = 0; i < UIP_UDP_CONNS; i++) {
 	    uip_udp_periodic(i);
@@ -192,6 +326,29 @@ int main(void)
 		}
 	    }
 	}
+	else
+	{
+	    /* Nothing on the network, let the file server catch up. */
+	    if(fsIdle())
+		workPost(WORK_FS);
+#if TRACE_UART
+	    if(traceDrain(1))
+		workPost(WORK_UART);
+#endif
+	    bootReport();
+	}
+
+	/* Give the card to the next download waiting for its turn. */
+	if((conn = httpd_sched_next()) != NULL)
+	{
+	    workPost(WORK_HTTP);
+	    uip_poll_conn(conn);
+	    if(uip_len > 0) 
+	    {
+		uip_arp_out();
+		network_send(uip_buf, uip_len);
+	    }
+	}
 
 	/* Call the ARP timer function every 10 seconds. */
 	if(timer_expired(&arp_timer)) 
@@ -201,6 +358,18 @@ int main(void)
 	    uip_arp_timer();
 	}
 #endif
+
+#if WORK_MEASURE
+	if(timer_expired(&measure_timer))
+	{
+	    timer_reset(&measure_timer);
+	    idle = workIdleRatio();
+	    pmesg(MSG_INFO, "idle %d.%d%%\n", idle / 10, idle % 10);
+	}
+#endif
+
+	/* Nothing posted during the pass: sleep until an interrupt. */
+	workSleep();
     } // while(1)
 
     return 0;
@@ -0,0 +1,51 @@
+#include "stack.h"
+
+/* From the linker script */
+extern DWORD _bss_end[], _top_stack[];
+
+/* Bytes from the first word that is not paint any more to top. */
+static DWORD highWater(DWORD *bottom, DWORD *top)
+{
+    DWORD *p = bottom;
+
+    while (p < top && *p == STACK_PAINT)
+	p++;
+    return (top - p) * sizeof(DWORD);
+}
+
+void stackUse(stackUse_t use[STACK_MODES])
+{
+    DWORD *top = _top_stack;
+    DWORD *bottom;
+
+    use[0].name = "fiq";
+    use[0].size = FIQ_STACK_SIZE;
+    use[0].used = highWater(top - FIQ_STACK_SIZE / 4, top);
+    top -= FIQ_STACK_SIZE / 4;
+
+    use[1].name = "irq";
+    use[1].size = IRQ_STACK_SIZE;
+    use[1].used = highWater(top - IRQ_STACK_SIZE / 4, top);
+    top -= IRQ_STACK_SIZE / 4;
+
+    /* Nothing stops the system stack at its size, look down to the
+       heap for how far it went. */
+    bottom = top - SYS_STACK_SIZE / 4;
+    while (bottom > _bss_end && bottom[-1] != STACK_PAINT)
+	bottom--;
+    use[2].name = "sys";
+    use[2].size = SYS_STACK_SIZE;
+    use[2].used = highWater(bottom, top);
+}
+
+DWORD stackFreeRam(void)
+{
+    DWORD *p = _top_stack - (FIQ_STACK_SIZE + IRQ_STACK_SIZE + SYS_STACK_SIZE) / 4;
+    DWORD n = 0;
+
+    while (p > _bss_end && p[-1] == STACK_PAINT) {
+	p--;
+	n += sizeof(DWORD);
+    }
+    return n;
+}
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include "trace.h"
+
+#if TRACE_EVENTS
+
+traceEvent_t traceRing[TRACE_EVENTS];
+DWORD traceHead;
+
+static DWORD drainPos;      /* Next event traceDrain() prints */
+
+DWORD traceStart(void)
+{
+    return traceHead > TRACE_EVENTS ? traceHead - TRACE_EVENTS : 0;
+}
+
+int traceRead(DWORD *pos, traceEvent_t *ev)
+{
+    DWORD first = traceStart();
+
+    if (*pos == traceHead)
+	return 0;
+    if (*pos < first) {
+	ev->time = traceRing[first % TRACE_EVENTS].time;
+	ev->id = TEV_LOST;
+	ev->arg1 = 0;
+	ev->arg2 = first - *pos;
+	*pos = first;
+	return 1;
+    }
+    *ev = traceRing[*pos % TRACE_EVENTS];
+    (*pos)++;
+    return 1;
+}
+
+void traceClock(traceEvent_t *ev)
+{
+    ev->time = trace_clock();
+    ev->id = TEV_CLOCK;
+    ev->arg1 = 0;
+    ev->arg2 = trace_clock_hz;
+}
+
+static void tracePrint(const traceEvent_t *ev)
+{
+    printf("T %08lx %04x %04x %08lx\n", (unsigned long)ev->time, ev->id,
+	    ev->arg1, (unsigned long)ev->arg2);
+}
+
+int traceDrain(int max)
+{
+    static char clock_sent;
+    traceEvent_t ev;
+
+    if (!clock_sent) {
+	traceClock(&ev);
+	tracePrint(&ev);
+	clock_sent = 1;
+    }
+    while (max-- > 0 && traceRead(&drainPos, &ev))
+	tracePrint(&ev);
+    return drainPos != traceHead;
+}
+
+#endif /* TRACE_EVENTS */
@@ -89,6 +89,8 @@
 
 #include <string.h>
 
+#include "trace.h"
+
 /*---------------------------------------------------------------------------*/
 /* Variable definitions. */
 
@@ -160,6 +162,11 @@ u16_t uip_len, uip_slen;
 				depending on the maximum packet
 				size. */
 
+static u16_t uip_sappsum, uip_sappsum_len;
+                             /* Precomputed sum and length of the
+				data to be sent, set by
+				uip_send_chksum(). */
+
 u8_t uip_flags;     /* The uip_flags variable is used for
 				communication between the TCP/IP stack
 				and the application program. */
@@ -347,9 +354,20 @@ upper_layer_chksum(u8_t proto)
   /* Sum IP source and destination addresses. */
   sum = chksum(sum, (u8_t *)&BUF->srcipaddr[0], 2 * sizeof(uip_ipaddr_t));
 
-  /* Sum TCP header and data. */
-  sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN],
-	       upper_layer_len);
+  if(proto == UIP_PROTO_TCP && uip_sappsum_len != 0 &&
+     upper_layer_len == UIP_TCPH_LEN + uip_sappsum_len) {
+    /* The application supplied the sum of the data with
+       uip_send_chksum(), so only the TCP header is summed here. */
+    sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN], UIP_TCPH_LEN);
+    sum += uip_sappsum;
+    if(sum < uip_sappsum) {
+      sum++;		/* carry */
+    }
+  } else {
+    /* Sum TCP header and data. */
+    sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN],
+		 upper_layer_len);
+  }
     
   return (sum == 0) ? 0xffff : htons(sum);
 }
@@ -686,6 +704,11 @@ uip_process(u8_t flag)
 {
   register struct uip_conn *uip_connr = uip_conn;
 
+  if(flag == UIP_DATA) {
+    /* Received packets only, not the periodic calls */
+    TRACE_EV(TEV_UIP, flag, uip_len);
+  }
+
 #if UIP_UDP
   if(flag == UIP_UDP_SEND_CONN) {
     goto udp_send;
@@ -693,6 +716,7 @@ uip_process(u8_t flag)
 #endif /* UIP_UDP */
   
   uip_sappdata = uip_appdata = &uip_buf[UIP_IPTCPH_LEN + UIP_LLH_LEN];
+  uip_sappsum_len = 0;
 
   /* Check if we were invoked because of a poll request for a
      particular connection. */
@@ -1868,6 +1892,7 @@ uip_process(u8_t flag)
    
   UIP_STAT(++uip_stat.tcp.sent);
  send:
+  TRACE_EV(TEV_UIP_SEND, 0, uip_len);
   DEBUG_PRINTF("Sending packet with length %d (%d)\n", uip_len,
 	       (BUF->len[0] << 8) | BUF->len[1]);
   
@@ -1890,6 +1915,11 @@ htons(u16_t val)
 void
 uip_send(const void *data, int len)
 {
+  if(data != uip_sappdata || len != uip_sappsum_len) {
+    /* Keep the precomputed sum only if the same data is sent again
+       in place, as protosockets do after a generator function. */
+    uip_sappsum_len = 0;
+  }
   if(len > 0) {
     uip_slen = len;
     if(data != uip_sappdata) {
@@ -1897,4 +1927,15 @@ uip_send(const void *data, int len)
     }
   }
 }
+/*---------------------------------------------------------------------------*/
+void
+uip_send_chksum(const void *data, int len, u16_t sum)
+{
+  uip_sappsum_len = 0;
+  uip_send(data, len);
+  if(len > 0) {
+    uip_sappsum = sum;
+    uip_sappsum_len = len;
+  }
+}
 /** @} */
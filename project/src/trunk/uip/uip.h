@@ -538,6 +538,25 @@ struct uip_conn *uip_connect(uip_ipaddr_t *ripaddr, u16_t port);
  */
 void uip_send(const void *data, int len);
 
+/**
+ * Send data on the current connection, with a precomputed checksum.
+ *
+ * This function works like uip_send(), but the caller also supplies
+ * the 16-bit one's complement sum of the data, in host byte order. If
+ * the whole segment is sent out unchanged, uIP folds this sum into
+ * the TCP checksum instead of summing the payload again. This is
+ * useful for constant data, such as pages built into the firmware,
+ * whose sums can be computed at build time. A protosocket generator
+ * function may call it on the data it placed in uip_appdata.
+ *
+ * \param data A pointer to the data which is to be sent.
+ *
+ * \param len The amount of data bytes to be sent.
+ *
+ * \param sum The one's complement sum of the data.
+ */
+void uip_send_chksum(const void *data, int len, u16_t sum);
+
 /**
  * The length of any incoming data that is currently avaliable (if avaliable)
  * in the uip_appdata buffer.
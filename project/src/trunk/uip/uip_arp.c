@@ -217,6 +217,70 @@ uip_arp_update(u16_t *ipaddr, struct uip_eth_addr *ethaddr)
   tabptr->time = arptime;
 }
 /*-----------------------------------------------------------------------------------*/
+/**
+ * Enter an IP to MAC address mapping learned elsewhere.
+ *
+ * Used at boot for the default router remembered from the previous
+ * run, so that the first packet sent to it is not replaced by an ARP
+ * request. The entry ages like any other.
+ */
+/*-----------------------------------------------------------------------------------*/
+void
+uip_arp_set(u16_t *ipaddr, struct uip_eth_addr *ethaddr)
+{
+  uip_arp_update(ipaddr, ethaddr);
+}
+/*-----------------------------------------------------------------------------------*/
+/**
+ * Look an IP address up in the ARP table.
+ *
+ * \return 1 with its MAC address copied to ethaddr if the address is
+ * in the table, 0 otherwise.
+ */
+/*-----------------------------------------------------------------------------------*/
+u8_t
+uip_arp_lookup(u16_t *ipaddr, struct uip_eth_addr *ethaddr)
+{
+  for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
+    if((arp_table[i].ipaddr[0] | arp_table[i].ipaddr[1]) != 0 &&
+       uip_ipaddr_cmp(ipaddr, arp_table[i].ipaddr)) {
+      memcpy(ethaddr->addr, arp_table[i].ethaddr.addr, 6);
+      return 1;
+    }
+  }
+  return 0;
+}
+/*-----------------------------------------------------------------------------------*/
+/**
+ * Build an ARP request for an IP address in the uip_buf[] buffer.
+ *
+ * The request is broadcast and uip_len set to its length, ready for
+ * the device driver. Asking for our own address makes it a gratuitous
+ * ARP, which updates the ARP caches of the other hosts on the link.
+ */
+/*-----------------------------------------------------------------------------------*/
+void
+uip_arp_request(u16_t *ipaddr)
+{
+  memset(BUF->ethhdr.dest.addr, 0xff, 6);
+  memset(BUF->dhwaddr.addr, 0x00, 6);
+  memcpy(BUF->ethhdr.src.addr, uip_ethaddr.addr, 6);
+  memcpy(BUF->shwaddr.addr, uip_ethaddr.addr, 6);
+
+  uip_ipaddr_copy(BUF->dipaddr, ipaddr);
+  uip_ipaddr_copy(BUF->sipaddr, uip_hostaddr);
+  BUF->opcode = HTONS(ARP_REQUEST); /* ARP request. */
+  BUF->hwtype = HTONS(ARP_HWTYPE_ETH);
+  BUF->protocol = HTONS(UIP_ETHTYPE_IP);
+  BUF->hwlen = 6;
+  BUF->protolen = 4;
+  BUF->ethhdr.type = HTONS(UIP_ETHTYPE_ARP);
+
+  uip_appdata = &uip_buf[UIP_TCPIP_HLEN + UIP_LLH_LEN];
+
+  uip_len = sizeof(struct arp_hdr);
+}
+/*-----------------------------------------------------------------------------------*/
 /**
  * ARP processing for incoming IP packets
  *
@@ -387,24 +451,7 @@ uip_arp_out(void)
     if(i == UIP_ARPTAB_SIZE) {
       /* The destination address was not in our ARP table, so we
 	 overwrite the IP packet with an ARP request. */
-
-      memset(BUF->ethhdr.dest.addr, 0xff, 6);
-      memset(BUF->dhwaddr.addr, 0x00, 6);
-      memcpy(BUF->ethhdr.src.addr, uip_ethaddr.addr, 6);
-      memcpy(BUF->shwaddr.addr, uip_ethaddr.addr, 6);
-    
-      uip_ipaddr_copy(BUF->dipaddr, ipaddr);
-      uip_ipaddr_copy(BUF->sipaddr, uip_hostaddr);
-      BUF->opcode = HTONS(ARP_REQUEST); /* ARP request. */
-      BUF->hwtype = HTONS(ARP_HWTYPE_ETH);
-      BUF->protocol = HTONS(UIP_ETHTYPE_IP);
-      BUF->hwlen = 6;
-      BUF->protolen = 4;
-      BUF->ethhdr.type = HTONS(UIP_ETHTYPE_ARP);
-
-      uip_appdata = &uip_buf[UIP_TCPIP_HLEN + UIP_LLH_LEN];
-    
-      uip_len = sizeof(struct arp_hdr);
+      uip_arp_request(ipaddr);
       return;
     }
 
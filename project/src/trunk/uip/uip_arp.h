@@ -107,6 +107,17 @@ void uip_arp_out(void);
    is responsible for flushing old entries in the ARP table. */
 void uip_arp_timer(void);
 
+/* The uip_arp_set() function enters a mapping known in advance, the
+   uip_arp_lookup() function returns 1 and the MAC address if the IP
+   address is in the ARP table. */
+void uip_arp_set(u16_t *ipaddr, struct uip_eth_addr *ethaddr);
+u8_t uip_arp_lookup(u16_t *ipaddr, struct uip_eth_addr *ethaddr);
+
+/* The uip_arp_request() function builds an ARP request for the IP
+   address in the uip_buf buffer, to be sent out as for uip_arp_out().
+   With our own address it is a gratuitous ARP. */
+void uip_arp_request(u16_t *ipaddr);
+
 /** @} */
 
 /**
@@ -0,0 +1,68 @@
+#include "lpc214x.h"
+#include "interrupt.h"
+#include "trace.h"
+#include "work.h"
+
+#define PCON_IDL    BIT0
+
+volatile DWORD workPending;
+
+#if WORK_MEASURE
+static DWORD idleTime;      /* trace_clock() ticks spent in idle mode */
+static DWORD measureStart;
+#endif
+
+void workPost(DWORD bits)
+{
+    uint32_t cpsr = save_interrupts();
+
+    workPending |= bits;
+    restore_interrupts(cpsr);
+}
+
+DWORD workTake(void)
+{
+    uint32_t cpsr = save_interrupts();
+    DWORD bits = workPending;
+
+    workPending = 0;
+    restore_interrupts(cpsr);
+    return bits;
+}
+
+void workSleep(void)
+{
+    uint32_t cpsr;
+#if WORK_MEASURE
+    DWORD start = trace_clock();
+#endif
+
+    cpsr = save_interrupts();
+    if (workPending) {
+	restore_interrupts(cpsr);
+	return;
+    }
+    /* An interrupt raised after the test still ends idle mode: the VIC
+       request wakes the core even while the CPSR masks it, and the
+       handler runs as soon as the interrupts are restored. */
+    PCON = PCON_IDL;
+    restore_interrupts(cpsr);
+#if WORK_MEASURE
+    idleTime += trace_clock() - start;
+#endif
+}
+
+#if WORK_MEASURE
+WORD workIdleRatio(void)
+{
+    DWORD now = trace_clock();
+    DWORD total = now - measureStart;
+    WORD ratio = 0;
+
+    if (total)
+	ratio = (WORD)((uint64_t)idleTime * 1000 / total);
+    idleTime = 0;
+    measureStart = now;
+    return ratio;
+}
+#endif